@@ -0,0 +1,437 @@
+#include "../core/meshlets.h"
+#include "../core/scene.h"
+#include "../core/vectors.h"
+#include "../rendering/scanline.h"
+#include "../rendering/stats.h"
+#include "perf_counters.h"
+#include <assert.h>
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef BENCH_BUILD_TYPE
+#define BENCH_BUILD_TYPE "unknown"
+#endif
+
+#define MAX_ENTRIES 64
+
+// Sizes (in triangles) of the small synthetic spheres
+//    of quick runs (-q), which replace the default ones
+static const int QUICK_SYNTHETIC[] = {2048, 4096};
+
+typedef struct {
+  char *data_dir;
+  char *output;
+  int repeats;
+  int resolutions[MAX_ENTRIES][2];
+  int n_resolutions;
+  int synthetic[MAX_ENTRIES];
+  int n_synthetic;
+
+  // Hardware counters, NULL if disabled
+  PerfCounters *perf;
+  RenderOptions options;
+} BenchConfig;
+
+int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+int compare_strings(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+double percentile(double *sorted, int n, double p) {
+  // Nearest-rank percentile over sorted samples
+  int rank = (int)ceil(p * n);
+  rank = (rank < 1) ? 1 : rank;
+  return sorted[rank - 1];
+}
+
+Object *generate_sphere(int n_triangles) {
+  // UV sphere with 2 * slices * (stacks - 1) triangles,
+  //    where slices = 2 * stacks. It's placed in the same
+  //    region as the bundled meshes.
+  int stacks = (int)ceil(sqrt(n_triangles / 4.0));
+  stacks = (stacks < 2) ? 2 : stacks;
+  int slices = 2 * stacks;
+  double radius = 150.0;
+  double center[3] = {0.0, 250.0, 0.0};
+
+  Object *object = (Object *)malloc(sizeof(Object));
+  object->n_vertices = 2 + (stacks - 1) * slices;
+  object->n_triangles = 2 * slices * (stacks - 1);
+  float *positions = (float *)malloc(3 * object->n_vertices * sizeof(float));
+  uint32_t *indices =
+      (uint32_t *)malloc(3 * object->n_triangles * sizeof(uint32_t));
+
+  // Vertices: north pole, rings and south pole
+  for (int i = 0; i < object->n_vertices; i++) {
+    double theta = 0.0, phi = 0.0;
+    if (i == object->n_vertices - 1) {
+      theta = M_PI;
+    } else if (i > 0) {
+      theta = M_PI * (1 + (i - 1) / slices) / stacks;
+      phi = 2.0 * M_PI * ((i - 1) % slices) / slices;
+    }
+
+    positions[3 * i] = center[0] + radius * sin(theta) * cos(phi);
+    positions[3 * i + 1] = center[1] + radius * cos(theta);
+    positions[3 * i + 2] = center[2] + radius * sin(theta) * sin(phi);
+  }
+
+  // Triangles: fans around the poles and quads between
+  //    rings, counter-clockwise when seen from outside,
+  //    like the bundled meshes
+  int t = 0;
+  int south = object->n_vertices - 1;
+  for (int s = 0; s < slices; s++) {
+    int next = (s + 1) % slices;
+    int ring = 1 + (stacks - 2) * slices;
+    uint32_t idx[2][3] = {{0, 1 + next, 1 + s},
+                          {south, ring + s, ring + next}};
+    for (int k = 0; k < 2; k++, t++) {
+      memcpy(indices + 3 * t, idx[k], 3 * sizeof(uint32_t));
+    }
+
+    for (int r = 0; r < stacks - 2; r++) {
+      int a = 1 + r * slices + s;
+      int b = 1 + r * slices + next;
+      int c = a + slices;
+      int d = b + slices;
+      uint32_t quad[2][3] = {{a, b, c}, {b, d, c}};
+      for (int k = 0; k < 2; k++, t++) {
+        memcpy(indices + 3 * t, quad[k], 3 * sizeof(uint32_t));
+      }
+    }
+  }
+  assert(t == object->n_triangles);
+
+  object->positions = positions;
+  object->indices = indices;
+  build_vertex_adjacency(object);
+  build_meshlets(object);
+  return object;
+}
+
+int list_meshes(char *objects_dir, char **names) {
+  DIR *dir = opendir(objects_dir);
+  struct dirent *entry;
+  int n = 0;
+  assert(dir != NULL);
+
+  while ((entry = readdir(dir)) != NULL && n < MAX_ENTRIES) {
+    size_t len = strlen(entry->d_name);
+    if (len > 4 && strcmp(entry->d_name + len - 4, ".byu") == 0) {
+      names[n++] = strdup(entry->d_name);
+    }
+  }
+  closedir(dir);
+
+  // Keep a stable order among runs
+  qsort(names, n, sizeof(char *), compare_strings);
+  return n;
+}
+
+int parse_list(char *arg, int *values, int stride) {
+  // Parses "a,b,c" (stride 1) or "AxB,CxD" (stride 2)
+  int n = 0;
+  for (char *token = strtok(arg, ","); token != NULL && n < MAX_ENTRIES;
+       token = strtok(NULL, ",")) {
+    if (stride == 2) {
+      int read = sscanf(token, "%dx%d", values + 2 * n, values + 2 * n + 1);
+      assert(read == 2);
+    } else {
+      values[n] = atoi(token);
+    }
+    n++;
+  }
+  return n;
+}
+
+double median_of(double *samples, int n) {
+  qsort(samples, n, sizeof(double), compare_doubles);
+  return percentile(samples, n, 0.5);
+}
+
+double safe_ratio(double a, double b) { return (b > 0.0) ? a / b : 0.0; }
+
+void write_perf_counters(PerfCounters *perf, int repeats, int n_triangles,
+                         long pixels_shaded, FILE *out) {
+  // Mean counts per frame of each stage. Shading is
+  //    attributed to the raster stage
+  unsigned long long total[N_PERF_EVENTS] = {0};
+  fprintf(out, "\"perf\": {");
+  for (int i = 0; i < N_STAGES; i++) {
+    unsigned long long *counts = perf->counts[i];
+    if (i == STAGE_SHADE) {
+      continue;
+    }
+
+    fprintf(out, "\"%s\": {", stage_name(i));
+    for (int e = 0; e < N_PERF_EVENTS; e++) {
+      total[e] += counts[e];
+      if (is_perf_event_available(perf, e)) {
+        fprintf(out, "\"%s\": %.1f, ", perf_event_name(e),
+                (double)counts[e] / repeats);
+      } else {
+        fprintf(out, "\"%s\": null, ", perf_event_name(e));
+      }
+    }
+
+    fprintf(out, "\"ipc\": %.3f}, ",
+            safe_ratio(counts[PERF_INSTRUCTIONS], counts[PERF_CYCLES]));
+  }
+
+  // Misses normalized by the geometry (transform, normals
+  //    and setup) and by the fragment (raster and shade) work
+  unsigned long long *raster = perf->counts[STAGE_RASTER];
+  double geometry[N_PERF_EVENTS];
+  for (int e = 0; e < N_PERF_EVENTS; e++) {
+    geometry[e] = perf->counts[STAGE_TRANSFORM][e] +
+                  perf->counts[STAGE_NORMALS][e] +
+                  perf->counts[STAGE_SETUP][e];
+  }
+  double triangles = (double)n_triangles * repeats;
+  double pixels = (double)pixels_shaded * repeats;
+  fprintf(out,
+          "\"cache_misses_per_triangle\": %.3f, "
+          "\"branch_misses_per_triangle\": %.3f, "
+          "\"cache_misses_per_pixel\": %.3f, "
+          "\"branch_misses_per_pixel\": %.3f, \"ipc\": %.3f}, ",
+          safe_ratio(geometry[PERF_CACHE_MISSES], triangles),
+          safe_ratio(geometry[PERF_BRANCH_MISSES], triangles),
+          safe_ratio(raster[PERF_CACHE_MISSES], pixels),
+          safe_ratio(raster[PERF_BRANCH_MISSES], pixels),
+          safe_ratio(total[PERF_INSTRUCTIONS], total[PERF_CYCLES]));
+}
+
+void bench_scene(Scene *scene, char *name, double load_time, BenchConfig *cfg,
+                 FILE *out) {
+  int n_triangles = 0;
+  double *times = (double *)malloc(cfg->repeats * sizeof(double));
+  double *stage_times = (double *)malloc(cfg->repeats * sizeof(double));
+  FrameStats *stats = (FrameStats *)calloc(cfg->repeats, sizeof(FrameStats));
+  for (int i = 0; i < scene->n_instances; i++) {
+    n_triangles += scene->instances[i].mesh->n_triangles;
+  }
+
+  for (int r = 0; r < cfg->n_resolutions; r++) {
+    int width = cfg->resolutions[r][0];
+    int height = cfg->resolutions[r][1];
+
+    // Warmup
+    Color **canvas = rasterize(scene, width, height, &cfg->options, NULL);
+    destroy_canvas(canvas, width, height);
+
+    if (cfg->perf != NULL) {
+      reset_perf_counters(cfg->perf);
+    }
+
+    for (int k = 0; k < cfg->repeats; k++) {
+      if (cfg->perf != NULL) {
+        attach_perf_counters(cfg->perf, stats + k);
+      }
+      reset_stats(stats + k);
+      double start = now_seconds();
+      canvas = rasterize(scene, width, height, &cfg->options, stats + k);
+      times[k] = now_seconds() - start;
+      destroy_canvas(canvas, width, height);
+    }
+
+    qsort(times, cfg->repeats, sizeof(double), compare_doubles);
+    double median = percentile(times, cfg->repeats, 0.5);
+    double p95 = percentile(times, cfg->repeats, 0.95);
+
+    // Counters are the same among repetitions
+    FrameStats *frame = stats;
+    fprintf(out,
+            "{\"mesh\": \"%s\", \"triangles\": %d, \"width\": %d, "
+            "\"height\": %d, \"mode\": \"%s\", \"shading\": \"%s\", "
+            "\"samples\": %d, \"workers\": %d, \"repeats\": %d, "
+            "\"build\": \"%s\", "
+            "\"precision\": \"%s\", "
+            "\"load_s\": %.6f, \"median_s\": %.6f, \"p95_s\": %.6f, "
+            "\"min_s\": %.6f, \"max_s\": %.6f, ",
+            name, n_triangles, width, height,
+            render_mode_name(cfg->options.mode),
+            shading_model_name(cfg->options.shading), cfg->options.samples,
+            scheduler_workers(cfg->options.scheduler), cfg->repeats,
+            BENCH_BUILD_TYPE, SCALAR_NAME, load_time, median, p95, times[0],
+            times[cfg->repeats - 1]);
+
+    // Median time of each stage
+    fprintf(out, "\"stage_median_s\": {");
+    for (int i = 0; i < N_STAGES; i++) {
+      for (int k = 0; k < cfg->repeats; k++) {
+        stage_times[k] = stats[k].time[i];
+      }
+      fprintf(out, "%s\"%s\": %.6f", i > 0 ? ", " : "", stage_name(i),
+              median_of(stage_times, cfg->repeats));
+    }
+
+    fprintf(out, "}, ");
+    if (cfg->perf != NULL) {
+      write_perf_counters(cfg->perf, cfg->repeats, n_triangles,
+                          frame->pixels_shaded, out);
+    }
+
+    fprintf(out,
+            "\"triangles_culled\": %ld, \"triangles_degenerate\": %ld, "
+            "\"fragments_tested\": %ld, \"fragments_passed\": %ld, "
+            "\"pixels_shaded\": %ld, \"triangles_per_s\": %.1f, "
+            "\"pixels_shaded_per_s\": %.1f}\n",
+            frame->triangles_culled, frame->triangles_degenerate,
+            frame->fragments_tested, frame->fragments_passed,
+            frame->pixels_shaded, n_triangles / median,
+            frame->pixels_shaded / median);
+    fflush(out);
+    fprintf(stderr, "[bench] %s %dx%d: mediana %.3f ms, p95 %.3f ms\n", name,
+            width, height, median * 1e3, p95 * 1e3);
+  }
+
+  free(times);
+  free(stage_times);
+  free(stats);
+}
+
+void usage(char *program) {
+  fprintf(stderr,
+          "Usage: %s [-d data_dir] [-n repeats] [-r WxH,...] "
+          "[-s n_triangles,...] [-a samples] [-m mode] [-l shading] "
+          "[-j workers] [-o output.jsonl] [-p] [-q]\n",
+          program);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  // Synthetic spheres span the mesh sizes where the
+  //    geometry stages dominate, up to a million triangles
+  BenchConfig cfg = {"data", "bench.jsonl", 5, {{300, 300}, {600, 600},
+                     {1200, 1200}}, 3, {100000, 300000, 1000000}, 3, NULL,
+                     default_render_options()};
+  char path[4096], camera_name[4096], light_name[4096];
+  char *names[MAX_ENTRIES];
+
+  // Serial by default
+  int workers = 1;
+  bool perf = false, quick = false, sizes = false;
+
+  // Parse options
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-p") == 0) {
+      perf = true;
+      continue;
+    } else if (strcmp(argv[i], "-q") == 0) {
+      quick = true;
+      continue;
+    }
+
+    if (i + 1 >= argc || argv[i][0] != '-') {
+      usage(argv[0]);
+    }
+
+    char *value = argv[++i];
+    switch (argv[i - 1][1]) {
+    case 'd':
+      cfg.data_dir = value;
+      break;
+    case 'n':
+      cfg.repeats = atoi(value);
+      break;
+    case 'r':
+      cfg.n_resolutions = parse_list(value, &cfg.resolutions[0][0], 2);
+      break;
+    case 's':
+      cfg.n_synthetic = parse_list(value, cfg.synthetic, 1);
+      sizes = true;
+      break;
+    case 'o':
+      cfg.output = value;
+      break;
+    case 'a':
+      cfg.options.samples = atoi(value);
+      break;
+    case 'm':
+      if (!parse_render_mode(value, &cfg.options.mode)) {
+        usage(argv[0]);
+      }
+      break;
+    case 'l':
+      if (!parse_shading_model(value, &cfg.options.shading)) {
+        usage(argv[0]);
+      }
+      break;
+    case 'j':
+      workers = atoi(value);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  assert(cfg.repeats > 0);
+
+  // Sizes given with -s take precedence
+  if (quick && !sizes) {
+    cfg.n_synthetic = sizeof(QUICK_SYNTHETIC) / sizeof(int);
+    memcpy(cfg.synthetic, QUICK_SYNTHETIC, sizeof(QUICK_SYNTHETIC));
+  }
+
+  // Optional hardware counters, opened before the
+  //    workers are created so that they're counted
+  if (perf) {
+    cfg.perf = open_perf_counters();
+    if (cfg.perf == NULL) {
+      fprintf(stderr, "[bench] Contadores de hardware indisponíveis.\n");
+    }
+  }
+  cfg.options.scheduler = create_scheduler(workers);
+
+  FILE *out = strcmp(cfg.output, "-") == 0 ? stdout : fopen(cfg.output, "w");
+  assert(out != NULL);
+  snprintf(camera_name, sizeof(camera_name), "%s/camera/camera_1.txt",
+           cfg.data_dir);
+  snprintf(light_name, sizeof(light_name), "%s/light/basic.lux",
+           cfg.data_dir);
+
+  // Bundled meshes
+  snprintf(path, sizeof(path), "%s/objects", cfg.data_dir);
+  int n_meshes = list_meshes(path, names);
+  for (int i = 0; i < n_meshes; i++) {
+    snprintf(path, sizeof(path), "%s/objects/%s", cfg.data_dir, names[i]);
+    double start = now_seconds();
+    Scene *scene = load_scene(camera_name, path, light_name);
+    double load_time = now_seconds() - start;
+    bench_scene(scene, names[i], load_time, &cfg, out);
+    destroy_scene(scene);
+    free(names[i]);
+  }
+
+  // Synthetic meshes
+  for (int i = 0; i < cfg.n_synthetic; i++) {
+    char name[64];
+    double start = now_seconds();
+    Object *sphere = generate_sphere(cfg.synthetic[i]);
+    Scene *scene = scene_from_mesh(load_camera(camera_name),
+                                   load_light(light_name), sphere);
+    double load_time = now_seconds() - start;
+    snprintf(name, sizeof(name), "sphere_%d", sphere->n_triangles);
+    bench_scene(scene, name, load_time, &cfg, out);
+    destroy_scene(scene);
+  }
+
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  if (cfg.perf != NULL) {
+    close_perf_counters(cfg.perf);
+  }
+  destroy_scheduler(cfg.options.scheduler);
+
+  return 0;
+}
@@ -0,0 +1,663 @@
+#include "../core/matrices.h"
+#include "../core/scene.h"
+#include "../core/vectors.h"
+#include "../rendering/light.h"
+#include "../rendering/math_utils.h"
+#include "../rendering/stats.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef BENCH_BUILD_TYPE
+#define BENCH_BUILD_TYPE "unknown"
+#endif
+
+// Number of distinct inputs of each case (power of 2),
+//    so that results can't be hoisted out of the loop
+#define N_INPUTS 256
+#define INPUT(i) ((i) & (N_INPUTS - 1))
+
+// Results are accumulated here so that the
+//    compiler can't discard the operations
+static volatile double sink;
+
+typedef struct {
+  // Heap inputs, as used by the pipeline
+  Vector *a[N_INPUTS], *b[N_INPUTS], *dst;
+  Vector *points[N_INPUTS];
+  Vector *P[N_INPUTS], *N[N_INPUTS];
+  Matrix *m[N_INPUTS];
+  RenderTriangles triangles;
+  BarycentricCoordinates coords[N_INPUTS];
+  Light *light;
+  int *sources;
+
+  // Same inputs as flat arrays
+  Scalar fa[N_INPUTS][3], fb[N_INPUTS][3];
+  Scalar fpoints[N_INPUTS][2];
+  Scalar fP[N_INPUTS][3], fN[N_INPUTS][3];
+  Scalar fm[N_INPUTS][3][3];
+  Scalar fwindow[N_INPUTS][3][2];
+  Scalar fnormals[N_INPUTS][3][3];
+} Fixture;
+
+typedef struct {
+  char *name;
+
+  // "heap" for the library functions, which operate on
+  //    heap-allocated Vectors, "flat" for variants on
+  //    plain arrays
+  char *variant;
+  void (*run)(Fixture *f, int n);
+} Case;
+
+typedef struct {
+  char *data_dir;
+  char *output;
+  char *filter;
+  int samples;
+  double min_time;
+} MicroConfig;
+
+double random_in(double lo, double hi) {
+  return lo + (hi - lo) * (rand() / (double)RAND_MAX);
+}
+
+void flat_cross(Scalar *a, Scalar *b, Scalar *dst) {
+  dst[0] = a[1] * b[2] - a[2] * b[1];
+  dst[1] = a[2] * b[0] - a[0] * b[2];
+  dst[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+Scalar flat_dot(Scalar *a, Scalar *b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+void flat_normalize(Scalar *a) {
+  Scalar aux = 1.0 / sqrt(flat_dot(a, a));
+  a[0] *= aux;
+  a[1] *= aux;
+  a[2] *= aux;
+}
+
+void flat_mult_matrix_by_vector(Scalar m[3][3], Scalar *b, Scalar *dst) {
+  for (int i = 0; i < 3; i++) {
+    dst[i] = m[i][0] * b[0] + m[i][1] * b[1] + m[i][2] * b[2];
+  }
+}
+
+void flat_inverse(Scalar m[3][3], Scalar dst[3][3]) {
+  // Adjugate divided by the determinant
+  dst[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+  dst[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+  dst[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+  dst[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+  dst[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+  dst[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+  dst[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+  dst[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+  dst[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+
+  Scalar det = m[0][0] * dst[0][0] + m[0][1] * dst[1][0] +
+               m[0][2] * dst[2][0];
+  Scalar aux = 1.0 / det;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      dst[i][j] *= aux;
+    }
+  }
+}
+
+BarycentricCoordinates flat_bcoordinates(Scalar *P, Scalar w[3][2]) {
+  Scalar v0[2] = {w[1][0] - w[0][0], w[1][1] - w[0][1]};
+  Scalar v1[2] = {w[2][0] - w[0][0], w[2][1] - w[0][1]};
+  Scalar v2[2] = {P[0] - w[0][0], P[1] - w[0][1]};
+  Scalar d00 = v0[0] * v0[0] + v0[1] * v0[1];
+  Scalar d01 = v0[0] * v1[0] + v0[1] * v1[1];
+  Scalar d11 = v1[0] * v1[0] + v1[1] * v1[1];
+  Scalar d20 = v2[0] * v0[0] + v2[1] * v0[1];
+  Scalar d21 = v2[0] * v1[0] + v2[1] * v1[1];
+  Scalar mult = 1.0 / (d00 * d11 - d01 * d01);
+  Scalar alpha = mult * (d00 * d21 - d01 * d20);
+  Scalar beta = mult * (d11 * d20 - d01 * d21);
+
+  BarycentricCoordinates coords = {1.0 - alpha - beta, beta, alpha};
+  return coords;
+}
+
+void flat_interpolate_normal(BarycentricCoordinates *P, Scalar n[3][3],
+                             Scalar *dst) {
+  for (int i = 0; i < 3; i++) {
+    dst[i] = P->alpha * n[0][i] + P->beta * n[1][i] + P->gamma * n[2][i];
+  }
+  flat_normalize(dst);
+}
+
+bool flat_is_valid_triangle(Scalar *A, Scalar *B, Scalar *C) {
+  Scalar area = A[0] * (B[1] - C[1]) + B[0] * (C[1] - A[1]) +
+                C[0] * (A[1] - B[1]);
+  area /= 2.0;
+
+  return isfinite(area) && fabs(area) > 0.01;
+}
+
+Scalar flat_attenuation(LightSource *source, Scalar *P) {
+  if (source->type == DIRECTIONAL_LIGHT || source->radius <= 0.0) {
+    return 1.0;
+  }
+
+  Scalar d[3] = {*source->pl->x - P[0], *source->pl->y - P[1],
+                 *source->pl->z - P[2]};
+  Scalar ratio = flat_dot(d, d) / (source->radius * source->radius);
+  Scalar window = 1.0 - ratio * ratio;
+  window = (window < 0.0) ? 0.0 : window;
+  return window * window;
+}
+
+int clip_channel(int c) { return (c > 255) ? 255 : ((c < 0) ? 0 : c); }
+
+Color flat_color_from_point(Scalar *P, Scalar *N, Light *light,
+                            Material *material, int *sources,
+                            int n_sources) {
+  // Same model as color_from_point, on plain arrays
+  Scalar V[3] = {-P[0], -P[1], -P[2]};
+  flat_normalize(V);
+  Scalar s = (flat_dot(V, N) <= 0.001) ? -1.0 : 1.0;
+  Scalar facing[3] = {s * N[0], s * N[1], s * N[2]};
+  Scalar kd[3] = {*material->kd->x * *material->od->x,
+                  *material->kd->y * *material->od->y,
+                  *material->kd->z * *material->od->z};
+  Color color = ambient_light(light);
+
+  for (int k = 0; k < n_sources; k++) {
+    LightSource *source = light->sources + sources[k];
+    Color diffuse = {0, 0, 0, 255};
+    Color specular = {0, 0, 0, 255};
+    Scalar attenuation = flat_attenuation(source, P);
+    Scalar L[3] = {*source->pl->x, *source->pl->y, *source->pl->z};
+
+    if (attenuation <= 0.0) {
+      continue;
+    }
+
+    if (source->type == DIRECTIONAL_LIGHT) {
+      L[0] = -L[0], L[1] = -L[1], L[2] = -L[2];
+    } else {
+      L[0] -= P[0], L[1] -= P[1], L[2] -= P[2];
+    }
+    flat_normalize(L);
+
+    Scalar aux = 2.0 * flat_dot(N, L);
+    Scalar R[3] = {aux * N[0] - L[0], aux * N[1] - L[1], aux * N[2] - L[2]};
+    flat_normalize(R);
+
+    Scalar cos_diffuse = flat_dot(facing, L);
+    Scalar cos_specular = flat_dot(R, V);
+    if (cos_diffuse > 0.001) {
+      diffuse.r = clip_channel((int)(cos_diffuse * kd[0] * source->local.r));
+      diffuse.g = clip_channel((int)(cos_diffuse * kd[1] * source->local.g));
+      diffuse.b = clip_channel((int)(cos_diffuse * kd[2] * source->local.b));
+      if (cos_specular >= 0) {
+        aux = material->ks * pow(cos_specular, material->eta);
+        specular = mult_scalar_color(aux, source->local);
+      }
+    }
+
+    if (attenuation < 1.0) {
+      diffuse = mult_scalar_color(attenuation, diffuse);
+      specular = mult_scalar_color(attenuation, specular);
+    }
+
+    color = add_color(color, add_color(diffuse, specular));
+  }
+
+  return color;
+}
+
+void run_cross_product_heap(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    Vector *c = cross_product(f->a[INPUT(i)], f->b[INPUT(i + 1)], NULL);
+    acc += *c->x;
+    destroy_vector(c);
+  }
+  sink = acc;
+}
+
+void run_cross_product_heap_dst(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    cross_product(f->a[INPUT(i)], f->b[INPUT(i + 1)], f->dst);
+    acc += *f->dst->x;
+  }
+  sink = acc;
+}
+
+void run_cross_product_flat(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    Scalar c[3];
+    flat_cross(f->fa[INPUT(i)], f->fb[INPUT(i + 1)], c);
+    acc += c[0];
+  }
+  sink = acc;
+}
+
+void run_mult_matrix_by_vector_heap(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    Vector *c = mult_matrix_by_vector(f->m[INPUT(i)], f->a[INPUT(i + 1)]);
+    acc += *c->x;
+    destroy_vector(c);
+  }
+  sink = acc;
+}
+
+void run_mult_matrix_by_vector_flat(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    Scalar c[3];
+    flat_mult_matrix_by_vector(f->fm[INPUT(i)], f->fa[INPUT(i + 1)], c);
+    acc += c[0];
+  }
+  sink = acc;
+}
+
+void run_inverse_heap(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    Matrix *inv = inverse(f->m[INPUT(i)], NULL);
+    acc += inv->arr[0][0];
+    destroy_matrix(inv);
+  }
+  sink = acc;
+}
+
+void run_inverse_flat(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    Scalar inv[3][3];
+    flat_inverse(f->fm[INPUT(i)], inv);
+    acc += inv[0][0];
+  }
+  sink = acc;
+}
+
+void run_bcoordinates_heap(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    BarycentricCoordinates c = get_bcoordinates_from_window(
+        f->points[INPUT(i)], &f->triangles, INPUT(i));
+    acc += c.alpha;
+  }
+  sink = acc;
+}
+
+void run_bcoordinates_flat(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    BarycentricCoordinates c =
+        flat_bcoordinates(f->fpoints[INPUT(i)], f->fwindow[INPUT(i)]);
+    acc += c.alpha;
+  }
+  sink = acc;
+}
+
+void run_interpolate_normal_heap(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    Vector *N = interpolate_normal(f->coords + INPUT(i), &f->triangles,
+                                   INPUT(i));
+    acc += *N->x;
+    destroy_vector(N);
+  }
+  sink = acc;
+}
+
+void run_interpolate_normal_flat(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    Scalar N[3];
+    flat_interpolate_normal(f->coords + INPUT(i), f->fnormals[INPUT(i)], N);
+    acc += N[0];
+  }
+  sink = acc;
+}
+
+void run_is_valid_triangle_heap(Fixture *f, int n) {
+  int acc = 0;
+  for (int i = 0; i < n; i++) {
+    acc += is_valid_triangle(f->points[INPUT(i)]->arr,
+                             f->points[INPUT(i + 1)]->arr,
+                             f->points[INPUT(i + 2)]->arr);
+  }
+  sink = acc;
+}
+
+void run_is_valid_triangle_flat(Fixture *f, int n) {
+  int acc = 0;
+  for (int i = 0; i < n; i++) {
+    acc += flat_is_valid_triangle(f->fpoints[INPUT(i)],
+                                  f->fpoints[INPUT(i + 1)],
+                                  f->fpoints[INPUT(i + 2)]);
+  }
+  sink = acc;
+}
+
+void run_ambient_light_heap(Fixture *f, int n) {
+  int acc = 0;
+  for (int i = 0; i < n; i++) {
+    acc += ambient_light(f->light).r;
+  }
+  sink = acc;
+}
+
+void run_diffuse_light_heap(Fixture *f, int n) {
+  int acc = 0;
+  for (int i = 0; i < n; i++) {
+    Color c = diffuse_light(f->light->sources, f->light->material,
+                            f->N[INPUT(i)], f->a[INPUT(i + 1)]);
+    acc += c.r;
+  }
+  sink = acc;
+}
+
+void run_specular_light_heap(Fixture *f, int n) {
+  int acc = 0;
+  for (int i = 0; i < n; i++) {
+    Color c = specular_light(f->light->sources, f->light->material,
+                             f->N[INPUT(i)], f->a[INPUT(i + 1)]);
+    acc += c.r;
+  }
+  sink = acc;
+}
+
+void run_light_attenuation_heap(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    acc += light_attenuation(f->light->sources, f->P[INPUT(i)]);
+  }
+  sink = acc;
+}
+
+void run_light_attenuation_flat(Fixture *f, int n) {
+  double acc = 0.0;
+  for (int i = 0; i < n; i++) {
+    acc += flat_attenuation(f->light->sources, f->fP[INPUT(i)]);
+  }
+  sink = acc;
+}
+
+void run_color_from_point_heap(Fixture *f, int n) {
+  int acc = 0;
+  for (int i = 0; i < n; i++) {
+    Color c = color_from_point(f->P[INPUT(i)], f->N[INPUT(i)], f->light,
+                               f->light->material, f->sources,
+                               f->light->n_sources);
+    acc += c.r + c.g + c.b;
+  }
+  sink = acc;
+}
+
+void run_color_from_point_flat(Fixture *f, int n) {
+  int acc = 0;
+  for (int i = 0; i < n; i++) {
+    Color c = flat_color_from_point(f->fP[INPUT(i)], f->fN[INPUT(i)],
+                                    f->light, f->light->material, f->sources,
+                                    f->light->n_sources);
+    acc += c.r + c.g + c.b;
+  }
+  sink = acc;
+}
+
+Case cases[] = {
+    {"cross_product", "heap", run_cross_product_heap},
+    {"cross_product", "heap_dst", run_cross_product_heap_dst},
+    {"cross_product", "flat", run_cross_product_flat},
+    {"mult_matrix_by_vector", "heap", run_mult_matrix_by_vector_heap},
+    {"mult_matrix_by_vector", "flat", run_mult_matrix_by_vector_flat},
+    {"inverse", "heap", run_inverse_heap},
+    {"inverse", "flat", run_inverse_flat},
+    {"get_bcoordinates_from_window", "heap", run_bcoordinates_heap},
+    {"get_bcoordinates_from_window", "flat", run_bcoordinates_flat},
+    {"interpolate_normal", "heap", run_interpolate_normal_heap},
+    {"interpolate_normal", "flat", run_interpolate_normal_flat},
+    {"is_valid_triangle", "heap", run_is_valid_triangle_heap},
+    {"is_valid_triangle", "flat", run_is_valid_triangle_flat},
+    {"ambient_light", "heap", run_ambient_light_heap},
+    {"diffuse_light", "heap", run_diffuse_light_heap},
+    {"specular_light", "heap", run_specular_light_heap},
+    {"light_attenuation", "heap", run_light_attenuation_heap},
+    {"light_attenuation", "flat", run_light_attenuation_flat},
+    {"color_from_point", "heap", run_color_from_point_heap},
+    {"color_from_point", "flat", run_color_from_point_flat},
+};
+
+Vector *random_vector(int dims, double lo, double hi, Scalar *flat) {
+  Vector *v = const_vector(dims, DIRECTION, 0.0);
+  for (int i = 0; i < dims; i++) {
+    v->arr[i] = flat[i] = random_in(lo, hi);
+  }
+  return v;
+}
+
+Vector *unit_vector(Scalar *flat) {
+  Scalar v[3] = {random_in(-1, 1), random_in(-1, 1), random_in(-1, 1) + 2.0};
+  flat_normalize(v);
+  memcpy(flat, v, sizeof(v));
+  return create_vector(3, DIRECTION, v[0], v[1], v[2]);
+}
+
+Fixture *create_fixture(Light *light) {
+  Fixture *f = (Fixture *)calloc(1, sizeof(Fixture));
+  assert(f != NULL);
+  srand(42);
+
+  // Triangles of the pipeline are already laid out as
+  //    arrays, which hold the same window coordinates
+  //    and normals as the flat inputs
+  RenderTriangles *T = &f->triangles;
+  T->n_triangles = N_INPUTS;
+  T->window = (Scalar(*)[2])f->fwindow;
+  T->normals = (Scalar(*)[3])f->fnormals;
+
+  for (int i = 0; i < N_INPUTS; i++) {
+    f->a[i] = random_vector(3, -1.0, 1.0, f->fa[i]);
+    f->b[i] = random_vector(3, -1.0, 1.0, f->fb[i]);
+    f->N[i] = unit_vector(f->fN[i]);
+
+    // Visible points in camera space, near the
+    //    bundled meshes
+    f->P[i] = random_vector(3, -100.0, 100.0, f->fP[i]);
+    f->fP[i][2] = *f->P[i]->z = random_in(600.0, 1000.0);
+
+    // Well-conditioned matrices
+    f->m[i] = const_matrix(3, 3, 0.0);
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < 3; k++) {
+        double value = random_in(-0.5, 0.5) + ((j == k) ? 2.0 : 0.0);
+        f->m[i]->arr[j][k] = f->fm[i][j][k] = value;
+      }
+    }
+
+    // Valid window triangles and points inside them
+    Scalar(*window)[2] = f->fwindow[i];
+    do {
+      for (int k = 0; k < 3; k++) {
+        window[k][0] = random_in(0.0, 600.0);
+        window[k][1] = random_in(0.0, 600.0);
+      }
+    } while (!is_valid_triangle(window[0], window[1], window[2]));
+
+    for (int k = 0; k < 3; k++) {
+      Scalar *normal = f->fnormals[i][k];
+      normal[0] = random_in(-1, 1);
+      normal[1] = random_in(-1, 1);
+      normal[2] = random_in(-1, 1) + 2.0;
+      flat_normalize(normal);
+    }
+
+    double u = random_in(0.0, 1.0), v = random_in(0.0, 1.0 - u);
+    BarycentricCoordinates c = {u, v, 1.0 - u - v};
+    f->coords[i] = c;
+    f->points[i] = const_vector(2, POINT, 0.0);
+    for (int k = 0; k < 2; k++) {
+      f->fpoints[i][k] = c.alpha * f->fwindow[i][0][k] +
+                         c.beta * f->fwindow[i][1][k] +
+                         c.gamma * f->fwindow[i][2][k];
+      f->points[i]->arr[k] = f->fpoints[i][k];
+    }
+  }
+
+  f->dst = const_vector(3, DIRECTION, 0.0);
+  f->light = light;
+  f->sources = (int *)malloc(light->n_sources * sizeof(int));
+  for (int i = 0; i < light->n_sources; i++) {
+    f->sources[i] = i;
+  }
+
+  return f;
+}
+
+void destroy_fixture(Fixture *f) {
+  for (int i = 0; i < N_INPUTS; i++) {
+    destroy_vector(f->a[i]);
+    destroy_vector(f->b[i]);
+    destroy_vector(f->N[i]);
+    destroy_vector(f->P[i]);
+    destroy_vector(f->points[i]);
+    destroy_matrix(f->m[i]);
+  }
+
+  destroy_vector(f->dst);
+  destroy_light(f->light);
+  free(f->sources);
+  free(f);
+}
+
+int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+int calibrate_batch(Case *c, Fixture *f, double min_time) {
+  // Double the batch until a single sample takes
+  //    at least min_time seconds
+  int batch = 1;
+  while (batch < (1 << 30)) {
+    double start = now_seconds();
+    c->run(f, batch);
+    if (now_seconds() - start >= min_time) {
+      break;
+    }
+    batch *= 2;
+  }
+  return batch;
+}
+
+void bench_case(Case *c, Fixture *f, MicroConfig *cfg, FILE *out) {
+  double *ns = (double *)malloc(cfg->samples * sizeof(double));
+  assert(ns != NULL);
+
+  // Warmup (also used to calibrate the batch size)
+  int batch = calibrate_batch(c, f, cfg->min_time);
+  for (int k = 0; k < 3; k++) {
+    c->run(f, batch);
+  }
+
+  double mean = 0.0, var = 0.0;
+  for (int k = 0; k < cfg->samples; k++) {
+    double start = now_seconds();
+    c->run(f, batch);
+    ns[k] = (now_seconds() - start) * 1e9 / batch;
+    mean += ns[k];
+  }
+  mean /= cfg->samples;
+  for (int k = 0; k < cfg->samples; k++) {
+    var += (ns[k] - mean) * (ns[k] - mean);
+  }
+  double stddev = (cfg->samples > 1) ? sqrt(var / (cfg->samples - 1)) : 0.0;
+
+  qsort(ns, cfg->samples, sizeof(double), compare_doubles);
+  double median = ns[cfg->samples / 2];
+  if (cfg->samples % 2 == 0) {
+    median = 0.5 * (median + ns[cfg->samples / 2 - 1]);
+  }
+
+  fprintf(out,
+          "{\"name\": \"%s\", \"variant\": \"%s\", \"build\": \"%s\", "
+          "\"precision\": \"%s\", \"samples\": %d, \"batch\": %d, "
+          "\"median_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f, "
+          "\"min_ns\": %.3f, \"max_ns\": %.3f}\n",
+          c->name, c->variant, BENCH_BUILD_TYPE, SCALAR_NAME, cfg->samples,
+          batch, median, mean, stddev, ns[0], ns[cfg->samples - 1]);
+  fflush(out);
+  fprintf(stderr, "[microbench] %-28s %-8s %9.2f ns/op (± %.2f)\n", c->name,
+          c->variant, median, stddev);
+  free(ns);
+}
+
+void usage(char *program) {
+  fprintf(stderr,
+          "Usage: %s [-d data_dir] [-n samples] [-t min_sample_ms] "
+          "[-f filter] [-o output.jsonl]\n",
+          program);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  MicroConfig cfg = {"data", "microbench.jsonl", NULL, 31, 0.005};
+  char light_name[4096];
+
+  // Parse options
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc || argv[i][0] != '-') {
+      usage(argv[0]);
+    }
+
+    char *value = argv[i + 1];
+    switch (argv[i][1]) {
+    case 'd':
+      cfg.data_dir = value;
+      break;
+    case 'n':
+      cfg.samples = atoi(value);
+      break;
+    case 't':
+      cfg.min_time = atof(value) / 1e3;
+      break;
+    case 'f':
+      cfg.filter = value;
+      break;
+    case 'o':
+      cfg.output = value;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  assert(cfg.samples > 0);
+
+  FILE *out = strcmp(cfg.output, "-") == 0 ? stdout : fopen(cfg.output, "w");
+  assert(out != NULL);
+  snprintf(light_name, sizeof(light_name), "%s/light/basic.lux",
+           cfg.data_dir);
+  Fixture *f = create_fixture(load_light(light_name));
+
+  for (int i = 0; i < (int)(sizeof(cases) / sizeof(Case)); i++) {
+    if (cfg.filter != NULL && strstr(cases[i].name, cfg.filter) == NULL) {
+      continue;
+    }
+    bench_case(cases + i, f, &cfg, out);
+  }
+
+  destroy_fixture(f);
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include "perf_counters.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+int open_event(PerfEvent event, int leader) {
+  static const unsigned long long configs[N_PERF_EVENTS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = configs[event];
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.disabled = (leader == -1);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  // Threads created afterwards (e.g., the workers of
+  //    a scheduler) are counted too, and reading the
+  //    group adds their counts
+  attr.inherit = 1;
+
+  // Current thread, any CPU
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+void read_counters(PerfCounters *perf, unsigned long long *values) {
+  // With PERF_FORMAT_GROUP, a single read returns
+  //    {nr, values[nr]} in the order events joined
+  unsigned long long buffer[1 + N_PERF_EVENTS];
+  ssize_t size = read(perf->leader, buffer, sizeof(buffer));
+  assert(size >= (ssize_t)sizeof(unsigned long long));
+
+  int k = 1;
+  for (int i = 0; i < N_PERF_EVENTS; i++) {
+    values[i] = (perf->fds[i] == -1) ? 0 : buffer[k++];
+  }
+}
+#endif
+
+void perf_hook(void *data, Stage active) {
+#ifdef __linux__
+  PerfCounters *perf = (PerfCounters *)data;
+  unsigned long long values[N_PERF_EVENTS];
+  read_counters(perf, values);
+
+  // Counts since the last transition belong
+  //    to the stage that was active
+  for (int i = 0; i < N_PERF_EVENTS; i++) {
+    if (active != N_STAGES) {
+      perf->counts[active][i] += values[i] - perf->last[i];
+    }
+    perf->last[i] = values[i];
+  }
+#endif
+}
+
+PerfCounters *open_perf_counters() {
+#ifdef __linux__
+  PerfCounters *perf = (PerfCounters *)calloc(1, sizeof(PerfCounters));
+  perf->leader = -1;
+  for (int i = 0; i < N_PERF_EVENTS; i++) {
+    perf->fds[i] = open_event(i, perf->leader);
+    if (perf->leader == -1) {
+      perf->leader = perf->fds[i];
+    }
+  }
+
+  if (perf->leader == -1) {
+    free(perf);
+    return NULL;
+  }
+
+  ioctl(perf->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(perf->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  read_counters(perf, perf->last);
+  return perf;
+#else
+  return NULL;
+#endif
+}
+
+void attach_perf_counters(PerfCounters *perf, FrameStats *stats) {
+  stats->hook = perf_hook;
+  stats->hook_data = perf;
+  stats->hook_stages = ~0u & ~(1u << STAGE_SHADE);
+}
+
+bool is_perf_event_available(PerfCounters *perf, PerfEvent event) {
+  return perf->fds[event] != -1;
+}
+
+const char *perf_event_name(PerfEvent event) {
+  static const char *names[N_PERF_EVENTS] = {"cycles", "instructions",
+                                             "cache_misses", "branch_misses"};
+  assert(event >= 0 && event < N_PERF_EVENTS);
+  return names[event];
+}
+
+void reset_perf_counters(PerfCounters *perf) {
+  memset(perf->counts, 0, sizeof(perf->counts));
+}
+
+void close_perf_counters(PerfCounters *perf) {
+#ifdef __linux__
+  // Members must be closed before the leader
+  for (int i = N_PERF_EVENTS - 1; i >= 0; i--) {
+    if (perf->fds[i] != -1 && perf->fds[i] != perf->leader) {
+      close(perf->fds[i]);
+    }
+  }
+  close(perf->leader);
+#endif
+  free(perf);
+}
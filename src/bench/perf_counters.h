@@ -0,0 +1,52 @@
+#ifndef BENCH_PERF_COUNTERS
+#define BENCH_PERF_COUNTERS
+#include "../rendering/stats.h"
+#include <stdbool.h>
+
+typedef enum {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  N_PERF_EVENTS
+} PerfEvent;
+
+typedef struct {
+  // File descriptors of the counters, where
+  //    unavailable events are -1
+  int fds[N_PERF_EVENTS];
+  int leader;
+
+  // Last value read from each counter
+  unsigned long long last[N_PERF_EVENTS];
+
+  // Accumulated counts for each pipeline stage
+  unsigned long long counts[N_STAGES][N_PERF_EVENTS];
+} PerfCounters;
+
+/*
+ * Open hardware counters (cycles, instructions, cache
+ * misses, branch misses) for the calling thread through
+ * perf_event_open. Threads it creates afterwards are also
+ * counted, so the counters must be opened before the
+ * scheduler whose workers should be included. Returns
+ * NULL if none of them is available (e.g., non-Linux
+ * systems or restricted perf_event_paranoid).
+ * */
+PerfCounters *open_perf_counters();
+
+/*
+ * Attribute counts to the pipeline stages recorded by
+ * stats. Shading isn't hooked (within rasterization, it's
+ * only timed on a sample of the pixels), so its counts
+ * are attributed to rasterization.
+ * */
+void attach_perf_counters(PerfCounters *perf, FrameStats *stats);
+
+// Utilities
+bool is_perf_event_available(PerfCounters *perf, PerfEvent event);
+const char *perf_event_name(PerfEvent event);
+void reset_perf_counters(PerfCounters *perf);
+void close_perf_counters(PerfCounters *perf);
+
+#endif
@@ -22,15 +22,15 @@ Matrix *maybe_alloc_matrix(Matrix *ptr, int rows, int columns) {
   return ptr;
 }
 
-Matrix *const_matrix(int rows, int columns, double value) {
+Matrix *const_matrix(int rows, int columns, Scalar value) {
   Matrix *matrix = (Matrix *)malloc(sizeof(Matrix));
   matrix->rows = rows;
   matrix->columns = columns;
 
   // Initializing array
-  double **vectors = (double **)malloc(rows * sizeof(double *));
+  Scalar **vectors = (Scalar **)malloc(rows * sizeof(Scalar *));
   for (int i = 0; i < rows; i++) {
-    vectors[i] = (double *)malloc(columns * sizeof(double));
+    vectors[i] = (Scalar *)malloc(columns * sizeof(Scalar));
     for (int j = 0; j < columns; j++) {
       vectors[i][j] = value;
     }
@@ -82,11 +82,11 @@ void print_matrix(Matrix *a, char *suffix) {
 
 Matrix *matrix_from_vector(Vector *a, bool copy) {
   Matrix *matrix = const_matrix(1, a->dims, 0.0);
-  double *target = a->arr;
+  Scalar *target = a->arr;
 
   // Create copy of original array if needed
   if (copy) {
-    target = (double *)malloc(a->dims * sizeof(double));
+    target = (Scalar *)malloc(a->dims * sizeof(Scalar));
     for (int i = 0; i < a->dims; i++) {
       target[i] = a->arr[i];
     }
@@ -135,7 +135,7 @@ Matrix *mult_matrix(Matrix *a, Matrix *b) {
   // Apply operation
   for (int i = 0; i < dst->rows; i++) {
     for (int j = 0; j < dst->columns; j++) {
-      double sum = 0.0;
+      Scalar sum = 0.0;
 
       for (int k = 0; k < a->columns; k++) {
         sum += a->arr[i][k] * b->arr[k][j];
@@ -153,7 +153,7 @@ Vector *mult_matrix_by_vector(Matrix *a, Vector *b) {
   Vector *dst = const_vector(a->rows, b->type, 0.0);
 
   for (int i = 0; i < dst->dims; i++) {
-    double sum = 0.0;
+    Scalar sum = 0.0;
     for (int j = 0; j < b->dims; j++) {
       sum += a->arr[i][j] * b->arr[j];
     }
@@ -180,20 +180,20 @@ Matrix *scalar_mult_matrix(float a, Matrix *b, Matrix *dst) {
 }
 
 Matrix *inverse(Matrix *a, Matrix *dst) {
-  double det = determinant(a);
+  Scalar det = determinant(a);
   assert(fabs(det) > 1e-8);
   dst = maybe_alloc_matrix(NULL, a->rows, a->columns);
 
   // Obtaining matrix entries
-  double a_ = a->arr[0][0];
-  double b = a->arr[0][1];
-  double c = a->arr[0][2];
-  double d = a->arr[1][0];
-  double e = a->arr[1][1];
-  double f = a->arr[1][2];
-  double g = a->arr[2][0];
-  double h = a->arr[2][1];
-  double i = a->arr[2][2];
+  Scalar a_ = a->arr[0][0];
+  Scalar b = a->arr[0][1];
+  Scalar c = a->arr[0][2];
+  Scalar d = a->arr[1][0];
+  Scalar e = a->arr[1][1];
+  Scalar f = a->arr[1][2];
+  Scalar g = a->arr[2][0];
+  Scalar h = a->arr[2][1];
+  Scalar i = a->arr[2][2];
 
   // Setting the values of new matrix
   dst->arr[0][0] = e * i - f * h;
@@ -211,27 +211,27 @@ Matrix *inverse(Matrix *a, Matrix *dst) {
   return dst;
 }
 
-double determinant(Matrix *a) {
+Scalar determinant(Matrix *a) {
   assert(a->rows == a->columns && a->rows == 3);
 
   // Obtaining matrix entries
-  double a_ = a->arr[0][0];
-  double b = a->arr[0][1];
-  double c = a->arr[0][2];
-  double d = a->arr[1][0];
-  double e = a->arr[1][1];
-  double f = a->arr[1][2];
-  double g = a->arr[2][0];
-  double h = a->arr[2][1];
-  double i = a->arr[2][2];
+  Scalar a_ = a->arr[0][0];
+  Scalar b = a->arr[0][1];
+  Scalar c = a->arr[0][2];
+  Scalar d = a->arr[1][0];
+  Scalar e = a->arr[1][1];
+  Scalar f = a->arr[1][2];
+  Scalar g = a->arr[2][0];
+  Scalar h = a->arr[2][1];
+  Scalar i = a->arr[2][2];
 
   // Obtaining terms
-  double term1 = a_ * e * i;
-  double term2 = b * f * g;
-  double term3 = c * d * h;
-  double term4 = c * e * g;
-  double term5 = b * d * i;
-  double term6 = a_ * f * h;
+  Scalar term1 = a_ * e * i;
+  Scalar term2 = b * f * g;
+  Scalar term3 = c * d * h;
+  Scalar term4 = c * e * g;
+  Scalar term5 = b * d * i;
+  Scalar term6 = a_ * f * h;
 
   // Obtain the determinant
   return term1 + term2 + term3 - term4 - term5 - term6;
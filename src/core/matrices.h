@@ -5,12 +5,12 @@
 #include <stdbool.h>
 
 typedef struct {
-  double **arr;
+  Scalar **arr;
   int rows, columns;
 } Matrix;
 
 // Initialization/destruction
-Matrix *const_matrix(int rows, int columns, double value);
+Matrix *const_matrix(int rows, int columns, Scalar value);
 void destroy_matrix(Matrix *matrix);
 
 // Utilities
@@ -25,6 +25,6 @@ Matrix *mult_matrix(Matrix *a, Matrix *b);
 Vector *mult_matrix_by_vector(Matrix *a, Vector *b);
 Matrix *scalar_mult_matrix(float a, Matrix *b, Matrix *dst);
 Matrix *inverse(Matrix *a, Matrix *dst);
-double determinant(Matrix *a);
+Scalar determinant(Matrix *a);
 
 #endif
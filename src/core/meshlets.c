@@ -0,0 +1,435 @@
+#include "meshlets.h"
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Cones whose normals deviate more than this from the
+//    axis (cosine of the angle) are never culled, since
+//    they would hardly ever face away from the camera
+#define MESHLET_MIN_CONE_COS 0.1
+
+// Relative margin of the meshlet bounds, which covers
+//    their rounding to single precision
+#define MESHLET_MARGIN 1e-4
+
+// State of the partition of a mesh
+typedef struct {
+  Object *mesh;
+
+  // Unit normal of each triangle (zero if degenerate)
+  //    and whether they point out of the mesh (1),
+  //    into it (-1) or the mesh isn't closed (0)
+  double *normals;
+  int orientation;
+
+  // Whether each triangle is in a meshlet and the
+  //    last meshlet that used each vertex
+  bool *assigned;
+  int *owner;
+
+  // Vertices of the current meshlet and the sum
+  //    of the normals of its triangles
+  int vertices[MESHLET_VERTICES];
+  double normal[3];
+} MeshletBuilder;
+
+// Partition utilities
+void meshlet_triangle_normal(Object *mesh, int t, double *normal);
+int new_meshlet_vertices(MeshletBuilder *builder, int t, int m);
+void add_meshlet_triangle(MeshletBuilder *builder, Meshlet *meshlet, int m,
+                          int t);
+int next_meshlet_triangle(MeshletBuilder *builder, Meshlet *meshlet, int m);
+void meshlet_bounds(MeshletBuilder *builder, Meshlet *meshlet);
+
+// Orientation utilities
+int mesh_orientation(Object *mesh);
+bool is_degenerate(Object *mesh, int t);
+bool has_edge(Object *mesh, int t, uint32_t a, uint32_t b);
+
+void build_meshlets(Object *object) {
+  int n = object->n_triangles;
+  object->meshlets = NULL;
+  object->meshlet_triangles = NULL;
+  object->n_meshlets = 0;
+  if (n <= 0) {
+    return;
+  }
+
+  MeshletBuilder builder = {object};
+  builder.normals = (double *)malloc(3 * n * sizeof(double));
+  builder.assigned = (bool *)calloc(n, sizeof(bool));
+  builder.owner = (int *)malloc(object->n_vertices * sizeof(int));
+  assert(builder.normals != NULL && builder.assigned != NULL &&
+         builder.owner != NULL);
+  for (int t = 0; t < n; t++) {
+    meshlet_triangle_normal(object, t, builder.normals + 3 * t);
+  }
+  for (int v = 0; v < object->n_vertices; v++) {
+    builder.owner[v] = -1;
+  }
+  builder.orientation = mesh_orientation(object);
+
+  // At most one meshlet per triangle, shrunk afterwards
+  object->meshlets = (Meshlet *)malloc(n * sizeof(Meshlet));
+  object->meshlet_triangles = (int *)malloc(n * sizeof(int));
+  assert(object->meshlets != NULL && object->meshlet_triangles != NULL);
+
+  // Each meshlet starts at the first triangle of the
+  //    mesh that wasn't assigned yet and grows through
+  //    its neighbours
+  int seed = 0, count = 0;
+  while (count < n) {
+    while (builder.assigned[seed]) {
+      seed++;
+    }
+
+    int m = object->n_meshlets++;
+    Meshlet *meshlet = object->meshlets + m;
+    meshlet->first = count;
+    meshlet->n_triangles = 0;
+    meshlet->n_vertices = 0;
+    builder.normal[0] = builder.normal[1] = builder.normal[2] = 0.0;
+
+    int t = seed;
+    while (t >= 0) {
+      add_meshlet_triangle(&builder, meshlet, m, t);
+      count++;
+      t = (meshlet->n_triangles < MESHLET_TRIANGLES)
+              ? next_meshlet_triangle(&builder, meshlet, m)
+              : -1;
+    }
+    meshlet_bounds(&builder, meshlet);
+  }
+
+  object->meshlets = (Meshlet *)realloc(
+      object->meshlets, object->n_meshlets * sizeof(Meshlet));
+  assert(object->meshlets != NULL);
+
+  // Cleanup
+  free(builder.normals);
+  free(builder.assigned);
+  free(builder.owner);
+}
+
+void meshlet_triangle_normal(Object *mesh, int t, double *normal) {
+  float *a = mesh->positions + 3 * mesh->indices[3 * t];
+  float *b = mesh->positions + 3 * mesh->indices[3 * t + 1];
+  float *c = mesh->positions + 3 * mesh->indices[3 * t + 2];
+
+  // (b - a) x (c - a), i.e., counter-clockwise
+  //    triangles face the viewer (see mesh_orientation)
+  double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  double v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+  normal[0] = u[1] * v[2] - u[2] * v[1];
+  normal[1] = u[2] * v[0] - u[0] * v[2];
+  normal[2] = u[0] * v[1] - u[1] * v[0];
+
+  double norm = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                     normal[2] * normal[2]);
+  for (int k = 0; k < 3; k++) {
+    normal[k] = (norm > 0.0) ? normal[k] / norm : 0.0;
+  }
+}
+
+int new_meshlet_vertices(MeshletBuilder *builder, int t, int m) {
+  uint32_t *v = builder->mesh->indices + 3 * t;
+  int count = 0;
+  for (int k = 0; k < 3; k++) {
+    // Repeated vertices (degenerate triangles)
+    //    are counted once
+    bool repeated = (k > 0 && v[k] == v[0]) || (k > 1 && v[k] == v[1]);
+    count += builder->owner[v[k]] != m && !repeated;
+  }
+
+  return count;
+}
+
+void add_meshlet_triangle(MeshletBuilder *builder, Meshlet *meshlet, int m,
+                          int t) {
+  Object *mesh = builder->mesh;
+  mesh->meshlet_triangles[meshlet->first + meshlet->n_triangles] = t;
+  meshlet->n_triangles++;
+  builder->assigned[t] = true;
+
+  for (int k = 0; k < 3; k++) {
+    uint32_t v = mesh->indices[3 * t + k];
+    if (builder->owner[v] != m) {
+      builder->owner[v] = m;
+      builder->vertices[meshlet->n_vertices++] = v;
+    }
+  }
+
+  for (int k = 0; k < 3; k++) {
+    builder->normal[k] += builder->normals[3 * t + k];
+  }
+}
+
+int next_meshlet_triangle(MeshletBuilder *builder, Meshlet *meshlet, int m) {
+  Object *mesh = builder->mesh;
+  double *normal = builder->normal;
+  double norm = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                     normal[2] * normal[2]);
+  norm = (norm > 0.0) ? 1.0 / norm : 0.0;
+
+  // Unassigned triangles sharing a vertex with the
+  //    meshlet, preferring the ones that add fewer
+  //    vertices and the ones facing its mean normal
+  int best = -1;
+  double best_score = INFINITY;
+  for (int i = 0; i < meshlet->n_vertices; i++) {
+    int v = builder->vertices[i];
+    for (int k = mesh->vertex_offsets[v]; k < mesh->vertex_offsets[v + 1];
+         k++) {
+      int t = mesh->vertex_triangles[k];
+      if (builder->assigned[t]) {
+        continue;
+      }
+
+      int added = new_meshlet_vertices(builder, t, m);
+      if (meshlet->n_vertices + added > MESHLET_VERTICES) {
+        continue;
+      }
+
+      double *n = builder->normals + 3 * t;
+      double score =
+          added - norm * (n[0] * normal[0] + n[1] * normal[1] +
+                          n[2] * normal[2]);
+      if (score < best_score || (score == best_score && t < best)) {
+        best = t;
+        best_score = score;
+      }
+    }
+  }
+
+  return best;
+}
+
+void meshlet_bounds(MeshletBuilder *builder, Meshlet *meshlet) {
+  Object *mesh = builder->mesh;
+
+  // Sphere centered at the bounding box of
+  //    the vertices
+  double min[3] = {INFINITY, INFINITY, INFINITY};
+  double max[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (int i = 0; i < meshlet->n_vertices; i++) {
+    float *p = mesh->positions + 3 * builder->vertices[i];
+    for (int k = 0; k < 3; k++) {
+      min[k] = fmin(min[k], p[k]);
+      max[k] = fmax(max[k], p[k]);
+    }
+  }
+
+  double radius = 0.0;
+  for (int k = 0; k < 3; k++) {
+    meshlet->center[k] = (float)((min[k] + max[k]) / 2);
+  }
+  for (int i = 0; i < meshlet->n_vertices; i++) {
+    float *p = mesh->positions + 3 * builder->vertices[i];
+    double d[3] = {p[0] - meshlet->center[0], p[1] - meshlet->center[1],
+                   p[2] - meshlet->center[2]};
+    radius = fmax(radius, sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+  }
+
+  // Rounded up, so that the sphere stays conservative
+  meshlet->radius = nextafterf((float)radius, INFINITY);
+
+  // Cone around the mean normal, whose aperture is the
+  //    largest deviation from it (degenerate triangles
+  //    don't face any direction)
+  double *normal = builder->normal;
+  double norm = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                     normal[2] * normal[2]);
+  double min_cos = 1.0;
+  for (int i = 0; i < meshlet->n_triangles && norm > 0.0; i++) {
+    int t = mesh->meshlet_triangles[meshlet->first + i];
+    double *n = builder->normals + 3 * t;
+    if (n[0] == 0.0 && n[1] == 0.0 && n[2] == 0.0) {
+      continue;
+    }
+    min_cos = fmin(min_cos, (n[0] * normal[0] + n[1] * normal[1] +
+                             n[2] * normal[2]) /
+                                norm);
+  }
+
+  // Axis pointing out of the mesh, without cones
+  //    if its back faces might be visible
+  int orientation = builder->orientation;
+  for (int k = 0; k < 3; k++) {
+    meshlet->axis[k] =
+        (norm > 0.0) ? (float)(orientation * normal[k] / norm) : 0.0f;
+  }
+  meshlet->cutoff =
+      (orientation != 0 && norm > 0.0 && min_cos > MESHLET_MIN_CONE_COS)
+          ? (float)sqrt(1.0 - min_cos * min_cos)
+          : 1.0f;
+}
+
+int mesh_orientation(Object *mesh) {
+  // The mesh is closed and consistently wound if each
+  //    edge of a triangle is traversed the other way by
+  //    exactly one more triangle (degenerate ones don't
+  //    cover anything, so they're ignored)
+  double volume = 0.0;
+  for (int t = 0; t < mesh->n_triangles; t++) {
+    if (is_degenerate(mesh, t)) {
+      continue;
+    }
+
+    uint32_t *v = mesh->indices + 3 * t;
+    for (int k = 0; k < 3; k++) {
+      uint32_t a = v[k], b = v[(k + 1) % 3];
+      int opposite = 0, same = 0;
+      for (int i = mesh->vertex_offsets[a]; i < mesh->vertex_offsets[a + 1];
+           i++) {
+        int u = mesh->vertex_triangles[i];
+        if (u != t) {
+          opposite += has_edge(mesh, u, b, a);
+          same += has_edge(mesh, u, a, b);
+        }
+      }
+      if (opposite != 1 || same != 0) {
+        return 0;
+      }
+    }
+
+    // Signed volume of the tetrahedron between the
+    //    triangle and the first vertex (times 6),
+    //    whose sum is positive if the normals of
+    //    the triangles point out of the mesh
+    float *o = mesh->positions;
+    float *p = mesh->positions + 3 * v[0];
+    float *q = mesh->positions + 3 * v[1];
+    float *r = mesh->positions + 3 * v[2];
+    double a[3] = {p[0] - o[0], p[1] - o[1], p[2] - o[2]};
+    double b[3] = {q[0] - o[0], q[1] - o[1], q[2] - o[2]};
+    double c[3] = {r[0] - o[0], r[1] - o[1], r[2] - o[2]};
+    volume += a[0] * (b[1] * c[2] - b[2] * c[1]) +
+              a[1] * (b[2] * c[0] - b[0] * c[2]) +
+              a[2] * (b[0] * c[1] - b[1] * c[0]);
+  }
+
+  return (volume > 0.0) ? 1 : ((volume < 0.0) ? -1 : 0);
+}
+
+bool is_degenerate(Object *mesh, int t) {
+  uint32_t *v = mesh->indices + 3 * t;
+  return v[0] == v[1] || v[1] == v[2] || v[2] == v[0];
+}
+
+bool has_edge(Object *mesh, int t, uint32_t a, uint32_t b) {
+  uint32_t *v = mesh->indices + 3 * t;
+  if (is_degenerate(mesh, t)) {
+    return false;
+  }
+
+  for (int k = 0; k < 3; k++) {
+    if (v[k] == a && v[(k + 1) % 3] == b) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int cull_meshlets(Instance *instance, SpaceConverter *cvt, int width,
+                  int height, bool backfaces, bool *kept) {
+  Object *mesh = instance->mesh;
+  Camera *camera = cvt->camera;
+  Scalar **model = instance->model->arr;
+  Scalar **view = cvt->world_to_camera->arr;
+
+  // Model transforms rotate scaled objects (see
+  //    model_matrix), so their longest column is
+  //    the largest stretch of the spheres
+  double scale = 0.0;
+  for (int k = 0; k < 3; k++) {
+    scale = fmax(scale, sqrt(model[0][k] * model[0][k] +
+                             model[1][k] * model[1][k] +
+                             model[2][k] * model[2][k]));
+  }
+
+  // Facing is tested in object space, since affine maps
+  //    keep the side of each triangle's plane where the
+  //    camera is, but mirroring ones flip the winding
+  double eye[3], offset[3];
+  Matrix *inverse_model = inverse(instance->model, NULL);
+  for (int r = 0; r < 3; r++) {
+    offset[r] = camera->C->arr[r] - instance->translation->arr[r];
+  }
+  for (int r = 0; r < 3; r++) {
+    eye[r] = 0.0;
+    for (int k = 0; k < 3; k++) {
+      eye[r] += inverse_model->arr[r][k] * offset[k];
+    }
+  }
+  double facing = (determinant(instance->model) < 0.0) ? -1.0 : 1.0;
+  destroy_matrix(inverse_model);
+
+  // From inside a closed mesh, only its back faces
+  //    are visible, so they're kept whenever the
+  //    camera is within the bounds of the meshlets
+  bool inside = true;
+  for (int k = 0; k < 3 && backfaces; k++) {
+    double min = INFINITY, max = -INFINITY;
+    for (int m = 0; m < mesh->n_meshlets; m++) {
+      Meshlet *meshlet = mesh->meshlets + m;
+      min = fmin(min, meshlet->center[k] - meshlet->radius);
+      max = fmax(max, meshlet->center[k] + meshlet->radius);
+    }
+    inside = inside && eye[k] >= min && eye[k] <= max;
+  }
+  backfaces = backfaces && !inside;
+
+  // Side planes of the frustum (|x| = ex * z and
+  //    |y| = ey * z), widened by a pixel, since window
+  //    coordinates are snapped
+  double ex = camera->hx * (1.0 + 2.0 / width) / camera->d;
+  double ey = camera->hy * (1.0 + 2.0 / height) / camera->d;
+  double nx = 1.0 / sqrt(1.0 + ex * ex), ny = 1.0 / sqrt(1.0 + ey * ey);
+
+  int culled = 0;
+  for (int m = 0; m < mesh->n_meshlets; m++) {
+    Meshlet *meshlet = mesh->meshlets + m;
+    float *center = meshlet->center;
+
+    // Sphere in camera space, same conversions
+    //    of the geometry stages
+    double world[3], c[3];
+    for (int r = 0; r < 3; r++) {
+      world[r] = instance->translation->arr[r] - camera->C->arr[r];
+      for (int k = 0; k < 3; k++) {
+        world[r] += model[r][k] * center[k];
+      }
+    }
+    for (int r = 0; r < 3; r++) {
+      c[r] = 0.0;
+      for (int k = 0; k < 3; k++) {
+        c[r] += view[r][k] * world[k];
+      }
+    }
+    double radius = (1.0 + MESHLET_MARGIN) * scale * meshlet->radius;
+    bool outside = c[2] < -radius || (fabs(c[0]) - ex * c[2]) * nx > radius ||
+                   (fabs(c[1]) - ey * c[2]) * ny > radius;
+
+    // Every point of the sphere sees every normal of the
+    //    cone from behind, i.e., the angle between the
+    //    axis and the view direction is below 90 - a
+    if (!outside && backfaces && meshlet->cutoff < 1.0f) {
+      double v[3] = {center[0] - eye[0], center[1] - eye[1],
+                     center[2] - eye[2]};
+      double distance = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+      double dot = facing * (v[0] * meshlet->axis[0] +
+                             v[1] * meshlet->axis[1] +
+                             v[2] * meshlet->axis[2]);
+      outside = dot > (meshlet->cutoff + MESHLET_MARGIN) * distance +
+                          meshlet->radius;
+    }
+
+    for (int i = 0; i < meshlet->n_triangles; i++) {
+      kept[mesh->meshlet_triangles[meshlet->first + i]] = !outside;
+    }
+    culled += outside;
+  }
+
+  return culled;
+}
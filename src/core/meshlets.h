@@ -0,0 +1,36 @@
+#ifndef MESHLETS
+#define MESHLETS
+#include "scene.h"
+
+// Maximum number of vertices and triangles of a meshlet
+#define MESHLET_VERTICES 64
+#define MESHLET_TRIANGLES 124
+
+/*
+ * Partition the triangles of a mesh in meshlets, small
+ * groups of connected triangles with their bounding sphere
+ * and normal cone, so that whole groups can be rejected
+ * before their vertices are transformed. Each meshlet
+ * grows from a seed triangle, taking the neighbours that
+ * add the fewest new vertices and deviate the least from
+ * its normals, until one of the limits above is reached.
+ * Normal cones point out of the mesh whatever the winding
+ * of its triangles, and are only built for closed meshes
+ * whose triangles are consistently wound, the only ones
+ * whose back faces are always hidden. The vertex
+ * adjacency of the mesh must be built first.
+ * */
+void build_meshlets(Object *object);
+
+/*
+ * Reject the meshlets of an instance whose bounding sphere
+ * is outside the view frustum (widened by a pixel) or
+ * behind the camera and, if backfaces is true, the ones
+ * whose normal cone faces away from it. kept[t] tells
+ * whether the meshlet of the mesh triangle t survived.
+ * Returns the number of meshlets that were rejected.
+ * */
+int cull_meshlets(Instance *instance, SpaceConverter *cvt, int width,
+                  int height, bool backfaces, bool *kept);
+
+#endif
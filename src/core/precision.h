@@ -0,0 +1,16 @@
+#ifndef PRECISION
+#define PRECISION
+
+// Scalar type of the geometry (vectors, matrices and
+//    depth), selected at compile time. Single precision
+//    is the default, while CG_DOUBLE_PRECISION selects
+//    double precision (e.g., for validation)
+#ifdef CG_DOUBLE_PRECISION
+typedef double Scalar;
+#define SCALAR_NAME "double"
+#else
+typedef float Scalar;
+#define SCALAR_NAME "float"
+#endif
+
+#endif
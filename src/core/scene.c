@@ -1,11 +1,20 @@
 #include "scene.h"
 #include "matrices.h"
+#include "meshlets.h"
 #include "vectors.h"
 #include <assert.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+void load_failure(char *filename, char *reason) {
+  // Malformed files are rejected even without
+  //    assertions (e.g., release builds)
+  fprintf(stderr, "[scene] Arquivo inválido %s: %s.\n", filename, reason);
+  exit(EXIT_FAILURE);
+}
 
 Camera *load_camera(char *filename) {
   Camera *camera = (Camera *)malloc(sizeof(Camera));
@@ -40,18 +49,24 @@ Camera *load_camera(char *filename) {
 Object *load_object(char *filename) {
   Object *object = (Object *)malloc(sizeof(Object));
   FILE *fp = fopen(filename, "r");
-  assert(fp != NULL);
+  if (fp == NULL) {
+    load_failure(filename, "não foi possível abri-lo");
+  }
 
   int n_vertices, n_triangles;
 
   // Readning number of vertices and triangles
-  fscanf(fp, "%d %d ", &n_vertices, &n_triangles);
+  if (fscanf(fp, "%d %d ", &n_vertices, &n_triangles) != 2 ||
+      n_vertices < 0 || n_triangles < 0) {
+    load_failure(filename, "número de vértices ou triângulos inválido");
+  }
   object->n_vertices = n_vertices;
   object->n_triangles = n_triangles;
 
   // Allocate vertices and triangles
-  Vector *vertices = (Vector *)malloc(n_vertices * sizeof(Vector));
-  Triangle *triangles = (Triangle *)malloc(n_triangles * sizeof(Triangle));
+  float *positions = (float *)malloc(3 * n_vertices * sizeof(float));
+  uint32_t *indices = (uint32_t *)malloc(3 * n_triangles * sizeof(uint32_t));
+  assert(positions != NULL && indices != NULL);
 
   // Store vertices
   for (int i = 0; i < n_vertices; i++) {
@@ -61,12 +76,9 @@ Object *load_object(char *filename) {
     fscanf(fp, "%f %f %f ", &x, &y, &z);
 
     // Assign values
-    vertices[i].dims = 3;
-    vertices[i].type = POINT;
-    vertices[i].arr = (double *)malloc(3 * sizeof(double));
-    vertices[i].arr[0] = x;
-    vertices[i].arr[1] = y;
-    vertices[i].arr[2] = z;
+    positions[3 * i] = x;
+    positions[3 * i + 1] = y;
+    positions[3 * i + 2] = z;
   }
 
   // Store triangles
@@ -74,29 +86,95 @@ Object *load_object(char *filename) {
     int tr1, tr2, tr3;
 
     // Load triangle information
-    fscanf(fp, "%d %d %d ", &tr1, &tr2, &tr3);
-
-    // Assign values
-    triangles[i].v1_idx = tr1 - 1;
-    triangles[i].v2_idx = tr2 - 1;
-    triangles[i].v3_idx = tr3 - 1;
-    triangles[i].v1 = vertices + triangles[i].v1_idx;
-    triangles[i].v2 = vertices + triangles[i].v2_idx;
-    triangles[i].v3 = vertices + triangles[i].v3_idx;
+    int read = fscanf(fp, "%d %d %d ", &tr1, &tr2, &tr3);
+
+    // Assign values (indices are 1-based in the file)
+    if (read != 3 || tr1 < 1 || tr2 < 1 || tr3 < 1 || tr1 > n_vertices ||
+        tr2 > n_vertices || tr3 > n_vertices) {
+      load_failure(filename, "índice de vértice inválido");
+    }
+    indices[3 * i] = tr1 - 1;
+    indices[3 * i + 1] = tr2 - 1;
+    indices[3 * i + 2] = tr3 - 1;
   }
 
   // Store in object
-  object->vertices = vertices;
-  object->triangles = triangles;
+  object->positions = positions;
+  object->indices = indices;
+  build_vertex_adjacency(object);
+  build_meshlets(object);
 
   return object;
 }
 
+Vector *get_vertex(Object *object, int i, Vector *dst) {
+  if (dst == NULL) {
+    dst = const_vector(3, POINT, 0.0);
+  }
+
+  float *p = object->positions + 3 * i;
+  *dst->x = p[0];
+  *dst->y = p[1];
+  *dst->z = p[2];
+  return dst;
+}
+
+void build_vertex_adjacency(Object *object) {
+  int n = object->n_triangles;
+  object->vertex_offsets = (int *)calloc(object->n_vertices + 1, sizeof(int));
+  object->vertex_triangles = (int *)malloc(3 * n * sizeof(int));
+  assert(object->vertex_offsets != NULL && object->vertex_triangles != NULL);
+
+  // Count the triangles of each vertex, then place
+  //    them after the ones of the previous vertices
+  int *offsets = object->vertex_offsets;
+  for (int i = 0; i < 3 * n; i++) {
+    offsets[object->indices[i] + 1]++;
+  }
+  for (int v = 0; v < object->n_vertices; v++) {
+    offsets[v + 1] += offsets[v];
+  }
+
+  int *next = (int *)malloc(object->n_vertices * sizeof(int));
+  assert(next != NULL);
+  memcpy(next, offsets, object->n_vertices * sizeof(int));
+  for (int i = 0; i < 3 * n; i++) {
+    object->vertex_triangles[next[object->indices[i]]++] = i / 3;
+  }
+  free(next);
+}
+
+void load_light_source(FILE *fp, LightSource *source) {
+  float x, y, z;
+
+  // Either a point or a directional light
+  if (fscanf(fp, " Pl = %f %f %f", &x, &y, &z) == 3) {
+    source->type = POINT_LIGHT;
+  } else {
+    fscanf(fp, " Dl = %f %f %f", &x, &y, &z);
+    source->type = DIRECTIONAL_LIGHT;
+  }
+  source->pl = create_vector(3, POINT, (double)x, (double)y, (double)z);
+
+  // Load local color
+  fscanf(fp, " Il = %d %d %d", &source->local.r, &source->local.g,
+         &source->local.b);
+  source->local.a = 255;
+
+  // Load optional influence radius
+  source->radius = 0.0;
+  if (source->type == POINT_LIGHT && fscanf(fp, " radius = %f", &x) == 1) {
+    source->radius = x;
+  }
+}
+
 Light *load_light(char *filename) {
   Light *light = (Light *)malloc(sizeof(Light));
+  LightSource main_source;
   Vector *aux = NULL;
   float scalar = 0.0;
   float x, y, z;
+  int n_extra = 0;
   FILE *fp = fopen(filename, "r");
   assert(fp != NULL);
 
@@ -110,9 +188,9 @@ Light *load_light(char *filename) {
   light->ka = scalar;
 
   // Load local color
-  fscanf(fp, "Il = %d %d %d ", &light->local.r, &light->local.g,
-         &light->local.b);
-  light->local.a = 255;
+  fscanf(fp, "Il = %d %d %d ", &main_source.local.r, &main_source.local.g,
+         &main_source.local.b);
+  main_source.local.a = 255;
 
   // Load Pl
   aux = const_vector(3, POINT, 0.0);
@@ -120,7 +198,12 @@ Light *load_light(char *filename) {
   aux->arr[0] = x;
   aux->arr[1] = y;
   aux->arr[2] = z;
-  light->pl = aux;
+  main_source.pl = aux;
+  main_source.type = POINT_LIGHT;
+  main_source.radius = 0.0;
+
+  // Load default material
+  light->material = (Material *)malloc(sizeof(Material));
 
   // Load Kd
   aux = const_vector(3, POINT, 0.0);
@@ -128,7 +211,7 @@ Light *load_light(char *filename) {
   aux->arr[0] = x;
   aux->arr[1] = y;
   aux->arr[2] = z;
-  light->kd = aux;
+  light->material->kd = aux;
 
   // Load Od
   aux = const_vector(3, POINT, 0.0);
@@ -136,19 +219,214 @@ Light *load_light(char *filename) {
   aux->arr[0] = x;
   aux->arr[1] = y;
   aux->arr[2] = z;
-  light->od = aux;
+  light->material->od = aux;
 
   // Load ks
   fscanf(fp, "Ks = %f ", &scalar);
-  light->ks = scalar;
+  light->material->ks = scalar;
 
   // Load eta
   fscanf(fp, "eta = %f ", &scalar);
-  light->eta = scalar;
+  light->material->eta = scalar;
+
+  // Load optional additional light sources
+  if (fscanf(fp, " lights = %d", &n_extra) != 1) {
+    n_extra = 0;
+  }
+  assert(n_extra >= 0);
+  light->n_sources = n_extra + 1;
+  light->sources =
+      (LightSource *)malloc(light->n_sources * sizeof(LightSource));
+  light->sources[0] = main_source;
+  for (int i = 1; i < light->n_sources; i++) {
+    load_light_source(fp, light->sources + i);
+  }
+
+  // Close the opened file
+  fclose(fp);
 
   return light;
 }
 
+bool has_extension(char *filename, char *extension) {
+  size_t len = strlen(filename);
+  size_t ext_len = strlen(extension);
+  return len >= ext_len && strcmp(filename + len - ext_len, extension) == 0;
+}
+
+void resolve_relative_path(char *base, char *name, char *dst, size_t size) {
+  // Absolute paths are kept as is
+  if (name[0] == '/' || name[0] == '\\' || strchr(name, ':') != NULL) {
+    snprintf(dst, size, "%s", name);
+    return;
+  }
+
+  // Otherwise, the path is relative to
+  //    the directory of base
+  char *slash = strrchr(base, '/');
+  char *backslash = strrchr(base, '\\');
+  if (backslash != NULL && (slash == NULL || backslash > slash)) {
+    slash = backslash;
+  }
+
+  if (slash == NULL) {
+    snprintf(dst, size, "%s", name);
+  } else {
+    snprintf(dst, size, "%.*s%s", (int)(slash - base + 1), base, name);
+  }
+}
+
+Vector *read_vector(FILE *fp, char *format) {
+  float x, y, z;
+  int read = fscanf(fp, format, &x, &y, &z);
+  assert(read == 3);
+  return create_vector(3, POINT, (double)x, (double)y, (double)z);
+}
+
+void load_instance(FILE *fp, char *filename, Scene *scene,
+                   Instance *instance) {
+  int mesh_idx;
+  float scalar;
+
+  // Load referenced mesh
+  if (fscanf(fp, " mesh = %d", &mesh_idx) != 1 || mesh_idx < 0 ||
+      mesh_idx >= scene->n_meshes) {
+    load_failure(filename, "índice de malha inválido");
+  }
+  instance->mesh = scene->meshes[mesh_idx];
+
+  // Load model transform
+  Vector *translation = read_vector(fp, " T = %f %f %f");
+  Vector *scale = read_vector(fp, " S = %f %f %f");
+  Vector *rotation = read_vector(fp, " R = %f %f %f");
+  instance->model = model_matrix(scale, rotation);
+  instance->translation = translation;
+  destroy_vector(scale);
+  destroy_vector(rotation);
+
+  // Load material, which is optional. If the
+  //    instance doesn't define one, we use the
+  //    default one from the light
+  Material *material = copy_material(scene->light->material);
+  float x, y, z;
+  if (fscanf(fp, " Kd = %f %f %f", &x, &y, &z) == 3) {
+    destroy_vector(material->kd);
+    destroy_vector(material->od);
+    material->kd = create_vector(3, POINT, (double)x, (double)y, (double)z);
+    material->od = read_vector(fp, " Od = %f %f %f");
+    fscanf(fp, " Ks = %f", &scalar);
+    material->ks = scalar;
+    fscanf(fp, " eta = %f", &scalar);
+    material->eta = scalar;
+  }
+  instance->material = material;
+}
+
+void load_scene_description(char *filename, Scene *scene) {
+  FILE *fp = fopen(filename, "r");
+  char name[4096], path[4096];
+  assert(fp != NULL);
+
+  // Load meshes, which are shared among instances
+  fscanf(fp, "meshes = %d ", &scene->n_meshes);
+  assert(scene->n_meshes > 0);
+  scene->meshes = (Object **)malloc(scene->n_meshes * sizeof(Object *));
+  for (int i = 0; i < scene->n_meshes; i++) {
+    fscanf(fp, "%4095s ", name);
+    resolve_relative_path(filename, name, path, sizeof(path));
+    scene->meshes[i] = load_object(path);
+  }
+
+  // Load instances
+  fscanf(fp, "instances = %d ", &scene->n_instances);
+  assert(scene->n_instances > 0);
+  scene->instances =
+      (Instance *)malloc(scene->n_instances * sizeof(Instance));
+  for (int i = 0; i < scene->n_instances; i++) {
+    load_instance(fp, filename, scene, scene->instances + i);
+  }
+
+  // Close the opened file
+  fclose(fp);
+}
+
+Scene *load_scene(char *camera_name, char *objects_name, char *light_name) {
+  Camera *camera = load_camera(camera_name);
+  Light *light = load_light(light_name);
+
+  if (has_extension(objects_name, ".byu")) {
+    // A single mesh is a scene with one
+    //    instance and identity transform
+    return scene_from_mesh(camera, light, load_object(objects_name));
+  }
+
+  Scene *scene = (Scene *)malloc(sizeof(Scene));
+  scene->camera = camera;
+  scene->light = light;
+  scene->cvt = get_converter(scene->camera);
+  load_scene_description(objects_name, scene);
+  return scene;
+}
+
+Scene *scene_from_mesh(Camera *camera, Light *light, Object *mesh) {
+  Scene *scene = (Scene *)malloc(sizeof(Scene));
+  Vector *scale = const_vector(3, DIRECTION, 1.0);
+  Vector *rotation = const_vector(3, DIRECTION, 0.0);
+  scene->camera = camera;
+  scene->light = light;
+  scene->cvt = get_converter(scene->camera);
+  scene->n_meshes = 1;
+  scene->meshes = (Object **)malloc(sizeof(Object *));
+  scene->meshes[0] = mesh;
+  scene->n_instances = 1;
+  scene->instances = (Instance *)malloc(sizeof(Instance));
+  scene->instances->mesh = mesh;
+  scene->instances->model = model_matrix(scale, rotation);
+  scene->instances->translation = const_vector(3, DIRECTION, 0.0);
+  scene->instances->material = copy_material(light->material);
+
+  // Cleanup
+  destroy_vector(scale);
+  destroy_vector(rotation);
+
+  return scene;
+}
+
+Material *copy_material(Material *a) {
+  Material *material = (Material *)malloc(sizeof(Material));
+  material->kd = copy_vector(a->kd, NULL);
+  material->od = copy_vector(a->od, NULL);
+  material->ks = a->ks;
+  material->eta = a->eta;
+  return material;
+}
+
+Matrix *model_matrix(Vector *scale, Vector *rotation) {
+  // Rotation angles are given in degrees
+  double rx = *rotation->x * M_PI / 180.0;
+  double ry = *rotation->y * M_PI / 180.0;
+  double rz = *rotation->z * M_PI / 180.0;
+  double cx = cos(rx), sx = sin(rx);
+  double cy = cos(ry), sy = sin(ry);
+  double cz = cos(rz), sz = sin(rz);
+
+  // R = Rz * Ry * Rx
+  double r[3][3] = {
+      {cz * cy, cz * sy * sx - sz * cx, cz * sy * cx + sz * sx},
+      {sz * cy, sz * sy * sx + cz * cx, sz * sy * cx - cz * sx},
+      {-sy, cy * sx, cy * cx}};
+
+  // M = R * S
+  Matrix *model = const_matrix(3, 3, 0.0);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      model->arr[i][j] = r[i][j] * scale->arr[j];
+    }
+  }
+
+  return model;
+}
+
 Color mult_scalar_color(double scalar, Color c) {
   int r, g, b;
 
@@ -226,6 +504,142 @@ SpaceConverter *get_converter(Camera *camera) {
   return cvt;
 }
 
+void set_scene_camera(Scene *scene, Camera *camera) {
+  destroy_converter(scene->cvt, false);
+  scene->camera = camera;
+  scene->cvt = get_converter(camera);
+}
+
+Camera *copy_camera(Camera *a) {
+  Camera *camera = (Camera *)malloc(sizeof(Camera));
+  camera->C = copy_vector(a->C, NULL);
+  camera->N = copy_vector(a->N, NULL);
+  camera->V = copy_vector(a->V, NULL);
+  camera->d = a->d;
+  camera->hx = a->hx;
+  camera->hy = a->hy;
+  return camera;
+}
+
+Vector *scene_center(Scene *scene) {
+  double min[3] = {INFINITY, INFINITY, INFINITY};
+  double max[3] = {-INFINITY, -INFINITY, -INFINITY};
+  Vector *vertex = const_vector(3, POINT, 0.0);
+  for (int i = 0; i < scene->n_instances; i++) {
+    Instance *instance = scene->instances + i;
+    for (int j = 0; j < instance->mesh->n_vertices; j++) {
+      get_vertex(instance->mesh, j, vertex);
+      Vector *world = cvt_object_to_world(vertex, instance);
+      for (int k = 0; k < 3; k++) {
+        min[k] = fmin(min[k], world->arr[k]);
+        max[k] = fmax(max[k], world->arr[k]);
+      }
+      destroy_vector(world);
+    }
+  }
+  destroy_vector(vertex);
+
+  if (min[0] > max[0]) {
+    // Empty scene
+    return const_vector(3, POINT, 0.0);
+  }
+
+  return create_vector(3, POINT, (min[0] + max[0]) / 2,
+                       (min[1] + max[1]) / 2, (min[2] + max[2]) / 2);
+}
+
+void camera_axes(Camera *camera, Vector *right, Vector *up) {
+  // Same bases used by the converter: V orthogonalized
+  //    against N and right = N x V
+  Vector *projection = projection_vector(camera->V, camera->N, NULL);
+  sub_vector(camera->V, projection, up);
+  scalar_mult_vector(1.0 / l2_norm(up), up, up);
+  cross_product(camera->N, up, right);
+  scalar_mult_vector(1.0 / l2_norm(right), right, right);
+  destroy_vector(projection);
+}
+
+Vector *orbit_target(Scene *scene) {
+  Camera *camera = scene->camera;
+  Vector *center = scene_center(scene);
+  Vector *N = scalar_mult_vector(1.0 / l2_norm(camera->N), camera->N, NULL);
+  Vector *offset = sub_vector(center, camera->C, NULL);
+  Vector *target = scalar_mult_vector(dot_product(offset, N), N, NULL);
+  add_vector(target, camera->C, target);
+
+  // Cleanup
+  destroy_vector(center);
+  destroy_vector(N);
+  destroy_vector(offset);
+  return target;
+}
+
+void orbit_camera(Camera *camera, Vector *target, double yaw, double pitch) {
+  Vector *right = const_vector(3, DIRECTION, 0.0);
+  Vector *up = const_vector(3, DIRECTION, 0.0);
+  Vector *offset = sub_vector(camera->C, target, NULL);
+
+  // Turn around the up axis, then around the
+  //    (updated) right axis
+  camera_axes(camera, right, up);
+  rotate_vector(offset, up, yaw, offset);
+  rotate_vector(camera->N, up, yaw, camera->N);
+  rotate_vector(camera->V, up, yaw, camera->V);
+
+  camera_axes(camera, right, up);
+  rotate_vector(offset, right, pitch, offset);
+  rotate_vector(camera->N, right, pitch, camera->N);
+  rotate_vector(camera->V, right, pitch, camera->V);
+  add_vector(target, offset, camera->C);
+
+  // Cleanup
+  destroy_vector(right);
+  destroy_vector(up);
+  destroy_vector(offset);
+}
+
+void pan_camera(Camera *camera, Vector *target, double dx, double dy) {
+  Vector *right = const_vector(3, DIRECTION, 0.0);
+  Vector *up = const_vector(3, DIRECTION, 0.0);
+  Vector *offset = sub_vector(target, camera->C, NULL);
+  camera_axes(camera, right, up);
+
+  // Size of half of the view at the target's distance
+  double distance = l2_norm(offset);
+  double sx = dx * distance * camera->hx / camera->d;
+  double sy = dy * distance * camera->hy / camera->d;
+  for (int i = 0; i < 3; i++) {
+    double shift = sx * right->arr[i] + sy * up->arr[i];
+    camera->C->arr[i] += shift;
+    target->arr[i] += shift;
+  }
+
+  // Cleanup
+  destroy_vector(right);
+  destroy_vector(up);
+  destroy_vector(offset);
+}
+
+void dolly_camera(Camera *camera, Vector *target, double factor) {
+  assert(factor > 0.0);
+  Vector *offset = sub_vector(camera->C, target, NULL);
+  scalar_mult_vector(factor, offset, offset);
+
+  // Never reach the target itself
+  if (l2_norm(offset) > 1e-3) {
+    add_vector(target, offset, camera->C);
+  }
+
+  destroy_vector(offset);
+}
+
+Vector *cvt_object_to_world(Vector *a, Instance *instance) {
+  // model * a + translation
+  Vector *new = mult_matrix_by_vector(instance->model, a);
+  add_vector(new, instance->translation, new);
+  return new;
+}
+
 Vector *cvt_world_to_camera(Vector *a, SpaceConverter *cvt) {
   // (a - C)
   Vector *tmp = sub_vector(a, cvt->camera->C, NULL);
@@ -259,14 +673,53 @@ Vector *cvt_camera_to_projection(Vector *a, Camera *camera, bool normalize) {
 
 Vector *cvt_projection_to_window(Vector *a, int width, int height) {
   Vector *new = const_vector(2, POINT, 0.0);
-  new->arr[0] = floor(width * (a->arr[0] + 1) / 2 + 0.5);
-  new->arr[1] = floor(height - (height * (a->arr[1] + 1) / 2) + 0.5);
+  // Continuous coordinates, where pixel (i, j) covers
+  //    [j, j + 1) x [i, i + 1), since the rasterizer
+  //    snaps them to its own subpixel grid
+  new->arr[0] = width * (a->arr[0] + 1) / 2;
+  new->arr[1] = height - (height * (a->arr[1] + 1) / 2);
 
   assert(isfinite(new->arr[0]));
   assert(isfinite(new->arr[1]));
   return new;
 }
 
+void transform_vertex(Instance *instance, SpaceConverter *cvt, int width,
+                      int height, int i, Scalar *camera, Scalar *window) {
+  // Same operations (and rounding) as the chain of
+  //    cvt_* functions, on the stack
+  float *p = instance->mesh->positions + 3 * i;
+  Scalar v[3] = {p[0], p[1], p[2]}, world[3];
+  for (int r = 0; r < 3; r++) {
+    Scalar sum = 0.0;
+    for (int c = 0; c < 3; c++) {
+      sum += instance->model->arr[r][c] * v[c];
+    }
+    world[r] = sum + instance->translation->arr[r];
+  }
+  for (int r = 0; r < 3; r++) {
+    world[r] = world[r] - cvt->camera->C->arr[r];
+  }
+  for (int r = 0; r < 3; r++) {
+    Scalar sum = 0.0;
+    for (int c = 0; c < 3; c++) {
+      sum += cvt->world_to_camera->arr[r][c] * world[c];
+    }
+    camera[r] = sum;
+  }
+
+  Camera *cam = cvt->camera;
+  Scalar x = cam->d * (camera[0] / camera[2]);
+  Scalar y = cam->d * (camera[1] / camera[2]);
+  x /= cam->hx;
+  y /= cam->hy;
+  window[0] = width * (x + 1) / 2;
+  window[1] = height - (height * (y + 1) / 2);
+
+  assert(isfinite(camera[0]) && isfinite(camera[1]) && isfinite(camera[2]));
+  assert(isfinite(window[0]) && isfinite(window[1]));
+}
+
 void destroy_camera(Camera *camera) {
   destroy_vector(camera->C);
   destroy_vector(camera->N);
@@ -275,24 +728,55 @@ void destroy_camera(Camera *camera) {
 }
 
 void destroy_object(Object *object) {
-  for (int i = 0; i < object->n_vertices; i++) {
-    free(object->vertices[i].arr);
-  }
-  for (int i = 0; i < object->n_triangles; i++) {
-    Triangle *t = object->triangles + i;
-  }
-  free(object->triangles);
-  free(object->vertices);
+  free(object->positions);
+  free(object->indices);
+  free(object->vertex_offsets);
+  free(object->vertex_triangles);
+  free(object->meshlets);
+  free(object->meshlet_triangles);
   free(object);
 }
 
 void destroy_light(Light *light) {
-  destroy_vector(light->pl);
-  destroy_vector(light->kd);
-  destroy_vector(light->od);
+  for (int i = 0; i < light->n_sources; i++) {
+    destroy_vector(light->sources[i].pl);
+  }
+  free(light->sources);
+  destroy_material(light->material);
   free(light);
 }
 
+void destroy_material(Material *material) {
+  destroy_vector(material->kd);
+  destroy_vector(material->od);
+  free(material);
+}
+
+void destroy_scene(Scene *scene) {
+  for (int i = 0; i < scene->n_meshes; i++) {
+    destroy_object(scene->meshes[i]);
+  }
+
+  destroy_light(scene->light);
+  destroy_shared_scene(scene);
+}
+
+void destroy_shared_scene(Scene *scene) {
+  // Instances only own their transform
+  //    and material
+  for (int i = 0; i < scene->n_instances; i++) {
+    Instance *instance = scene->instances + i;
+    destroy_matrix(instance->model);
+    destroy_vector(instance->translation);
+    destroy_material(instance->material);
+  }
+
+  free(scene->instances);
+  free(scene->meshes);
+  destroy_converter(scene->cvt, false);
+  free(scene);
+}
+
 void destroy_converter(SpaceConverter *cvt, bool keep_camera) {
   destroy_matrix(cvt->camera_to_world);
   destroy_matrix(cvt->world_to_camera);
@@ -4,15 +4,42 @@
 #include "matrices.h"
 #include "vectors.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct {
   int r, g, b, a;
 } Color;
 
 typedef struct {
-  Vector *pl, *kd, *od;
-  Color ambient, local;
-  double ka, ks, eta;
+  Vector *kd, *od;
+  double ks, eta;
+} Material;
+
+typedef enum { POINT_LIGHT, DIRECTIONAL_LIGHT } LightType;
+
+typedef struct {
+  LightType type;
+
+  // Position (point lights) or direction of
+  //    propagation (directional lights), both
+  //    given in camera space
+  Vector *pl;
+  Color local;
+
+  // Influence radius of point lights, where
+  //    zero means unbounded
+  double radius;
+} LightSource;
+
+typedef struct {
+  Color ambient;
+  double ka;
+  LightSource *sources;
+  int n_sources;
+
+  // Default material, used by objects
+  //    that don't define their own
+  Material *material;
 } Light;
 
 typedef struct {
@@ -21,29 +48,105 @@ typedef struct {
 } Camera;
 
 typedef struct {
-  Vector *v1;
-  Vector *v2;
-  Vector *v3;
-  int v1_idx, v2_idx, v3_idx;
-} Triangle;
+  // Triangles of the meshlet are the mesh triangles
+  //    meshlet_triangles[first:first + n_triangles],
+  //    which use n_vertices distinct vertices
+  int first, n_triangles, n_vertices;
+
+  // Bounding sphere, in object space
+  float center[3], radius;
+
+  // Normal cone: the outward normal of every triangle
+  //    is within an angle a of axis, where cutoff =
+  //    sin(a), or cutoff = 1 if the cone is too wide to
+  //    be culled or the mesh isn't closed
+  float axis[3], cutoff;
+} Meshlet;
 
 typedef struct {
-  Vector *vertices;
-  Triangle *triangles;
+  // Flat arrays, where vertex i is positions[3 * i],
+  //    positions[3 * i + 1] and positions[3 * i + 2],
+  //    and triangle t is made of the vertices
+  //    indices[3 * t], indices[3 * t + 1] and
+  //    indices[3 * t + 2]
+  float *positions;
+  uint32_t *indices;
   int n_vertices, n_triangles;
+
+  // Triangles using each vertex v, in increasing order,
+  //    which are vertex_triangles[vertex_offsets[v]:
+  //    vertex_offsets[v + 1]]
+  int *vertex_offsets, *vertex_triangles;
+
+  // Partition of the triangles in meshlets, built
+  //    once the mesh is loaded (see meshlets.h)
+  Meshlet *meshlets;
+  int *meshlet_triangles;
+  int n_meshlets;
 } Object;
 
+typedef struct {
+  // Shared mesh (not owned by the instance)
+  Object *mesh;
+
+  // Model transform: world = model * v + translation
+  Matrix *model;
+  Vector *translation;
+
+  Material *material;
+} Instance;
+
 typedef struct {
   Matrix *world_to_camera;
   Matrix *camera_to_world;
   Camera *camera;
 } SpaceConverter;
 
+typedef struct {
+  Camera *camera;
+  Light *light;
+  SpaceConverter *cvt;
+  Object **meshes;
+  Instance *instances;
+  int n_meshes, n_instances;
+} Scene;
+
 // Loading functions
 Camera *load_camera(char *filename);
 Object *load_object(char *filename);
 Light *load_light(char *filename);
 
+/*
+ * Obtain the vertex i of an object as a point. If dst
+ * is NULL, a new vector is allocated.
+ * */
+Vector *get_vertex(Object *object, int i, Vector *dst);
+
+/*
+ * Build the triangles using each vertex of an object,
+ * once its positions and indices are set.
+ * */
+void build_vertex_adjacency(Object *object);
+
+/*
+ * Load a scene given its camera, objects and light. The
+ * objects file can either be a single mesh (.byu) or a
+ * scene description listing meshes and their instances.
+ * */
+Scene *load_scene(char *camera_name, char *objects_name, char *light_name);
+
+/*
+ * Create a scene with a single instance of mesh, using
+ * an identity transform and the default material. The
+ * scene takes ownership of every argument, unless it's
+ * destroyed by destroy_shared_scene.
+ * */
+Scene *scene_from_mesh(Camera *camera, Light *light, Object *mesh);
+
+// Materials and instances
+Material *copy_material(Material *a);
+Matrix *model_matrix(Vector *scale, Vector *rotation);
+
 // Color manipulation
 Color mult_scalar_color(double scalar, Color c);
 Color add_color(Color a, Color b);
@@ -51,15 +154,77 @@ Color add_color(Color a, Color b);
 // Conversion matrices
 SpaceConverter *get_converter(Camera *camera);
 
+/*
+ * Replace the camera of a scene, updating its converter.
+ * The scene takes ownership of camera.
+ * */
+void set_scene_camera(Scene *scene, Camera *camera);
+
+// Camera navigation
+Camera *copy_camera(Camera *a);
+
+/*
+ * Obtain the center of the bounding box of every
+ * instance of the scene, in world space.
+ * */
+Vector *scene_center(Scene *scene);
+
+/*
+ * Obtain the point of the view direction of the scene
+ * camera that's closest to the center of the scene, in
+ * world space, which is used as the pivot when orbiting.
+ * */
+Vector *orbit_target(Scene *scene);
+
+/*
+ * Rotate the camera around the target point, where yaw
+ * turns around the camera's up axis (V) and pitch around
+ * its right axis. Angles are given in degrees.
+ * */
+void orbit_camera(Camera *camera, Vector *target, double yaw, double pitch);
+
+/*
+ * Translate both the camera and the target along the
+ * view plane. Offsets are given in normalized window
+ * units at the target's distance, where 1 is half of
+ * the view.
+ * */
+void pan_camera(Camera *camera, Vector *target, double dx, double dy);
+
+/*
+ * Move the camera towards the target, scaling their
+ * distance by factor.
+ * */
+void dolly_camera(Camera *camera, Vector *target, double factor);
+
 // Space mapping
+Vector *cvt_object_to_world(Vector *a, Instance *instance);
 Vector *cvt_world_to_camera(Vector *a, SpaceConverter *cvt);
 Vector *cvt_camera_to_projection(Vector *a, Camera *camera, bool normalize);
 Vector *cvt_projection_to_window(Vector *a, int width, int height);
 
+/*
+ * Transform the vertex i of an instance's mesh to camera
+ * space and window coordinates, same as the conversions
+ * above (with a normalized projection) but without
+ * allocating any vector.
+ * */
+void transform_vertex(Instance *instance, SpaceConverter *cvt, int width,
+                      int height, int i, Scalar *camera, Scalar *window);
+
 // Utilities
 void destroy_camera(Camera *camera);
 void destroy_object(Object *object);
 void destroy_light(Light *light);
+void destroy_material(Material *material);
+void destroy_scene(Scene *scene);
+
+/*
+ * Destroy a scene, except for its meshes and light, which
+ * can then be shared by several scenes (e.g., resident
+ * resources of the render server).
+ * */
+void destroy_shared_scene(Scene *scene);
 void destroy_converter(SpaceConverter *cvt, bool keep_camera);
 
 #endif
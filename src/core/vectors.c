@@ -13,19 +13,19 @@ Vector *maybe_alloc_vector(Vector *ptr, int dims, VectorType type) {
   return ptr;
 }
 
-Vector *const_vector(int dims, VectorType type, double value) {
+Vector *const_vector(int dims, VectorType type, Scalar value) {
   Vector *vector = (Vector *)malloc(sizeof(Vector));
   assert(vector != NULL);
 
   vector->dims = dims;
   vector->type = type;
-  vector->arr = (double *)malloc(dims * sizeof(double));
+  vector->arr = (Scalar *)malloc(dims * sizeof(Scalar));
   vector->x = NULL;
   vector->y = NULL;
   vector->z = NULL;
 
   for (int i = 0; i < dims; i++) {
-    double *ptr = vector->arr + i;
+    Scalar *ptr = vector->arr + i;
     *ptr = value;
     switch (i) {
     case 0:
@@ -49,8 +49,8 @@ Vector *create_vector(int dims, VectorType type, ...) {
 
   Vector *vector = const_vector(dims, type, 0.0);
   for (int i = 0; i < dims; i++) {
-    double value = va_arg(args, double);
-    double *ptr = vector->arr + i;
+    Scalar value = va_arg(args, double);
+    Scalar *ptr = vector->arr + i;
     *ptr = value;
     switch (i) {
     case 0:
@@ -81,9 +81,9 @@ Vector *copy_vector(Vector *a, Vector *dst) {
 
   dst->dims = a->dims;
   dst->type = a->type;
-  dst->arr = (double *)malloc(dst->dims * sizeof(double));
+  dst->arr = (Scalar *)malloc(dst->dims * sizeof(Scalar));
   for (int i = 0; i < dst->dims; i++) {
-    double *ptr = dst->arr + i;
+    Scalar *ptr = dst->arr + i;
     *ptr = a->arr[i];
     switch (i) {
     case 0:
@@ -141,9 +141,9 @@ Vector *cross_product(Vector *a, Vector *b, Vector *dst) {
   dst = maybe_alloc_vector(dst, a->dims, a->type);
 
   // Calculate cross product
-  double x = (*a->y) * (*b->z) - (*a->z) * (*b->y);
-  double y = (*a->z) * (*b->x) - (*a->x) * (*b->z);
-  double z = (*a->x) * (*b->y) - (*a->y) * (*b->x);
+  Scalar x = (*a->y) * (*b->z) - (*a->z) * (*b->y);
+  Scalar y = (*a->z) * (*b->x) - (*a->x) * (*b->z);
+  Scalar z = (*a->x) * (*b->y) - (*a->y) * (*b->x);
 
   // Assign new values
   *dst->x = x;
@@ -164,7 +164,7 @@ Vector *element_wise_prod(Vector *a, Vector *b, Vector *dst) {
   return dst;
 }
 
-Vector *scalar_mult_vector(double a, Vector *b, Vector *dst) {
+Vector *scalar_mult_vector(Scalar a, Vector *b, Vector *dst) {
   dst = maybe_alloc_vector(dst, b->dims, b->type);
 
   for (int i = 0; i < dst->dims; i++) {
@@ -179,9 +179,32 @@ Vector *projection_vector(Vector *a, Vector *b, Vector *dst) {
   return scalar_mult_vector(scalar, b, dst);
 }
 
-double dot_product(Vector *a, Vector *b) {
+Vector *rotate_vector(Vector *a, Vector *axis, double degrees, Vector *dst) {
+  assert(a->dims == axis->dims && a->dims == 3);
+  dst = maybe_alloc_vector(dst, a->dims, a->type);
+
+  // Rodrigues' rotation formula around the
+  //    normalized axis k:
+  //    a cos + (k x a) sin + k (k . a) (1 - cos)
+  double theta = degrees * M_PI / 180.0;
+  double c = cos(theta), s = sin(theta);
+  double norm = l2_norm(axis);
+  double k[3] = {*axis->x / norm, *axis->y / norm, *axis->z / norm};
+  double v[3] = {*a->x, *a->y, *a->z};
+  double kv = k[0] * v[0] + k[1] * v[1] + k[2] * v[2];
+  double cross[3] = {k[1] * v[2] - k[2] * v[1], k[2] * v[0] - k[0] * v[2],
+                     k[0] * v[1] - k[1] * v[0]};
+
+  for (int i = 0; i < 3; i++) {
+    dst->arr[i] = v[i] * c + cross[i] * s + k[i] * kv * (1.0 - c);
+  }
+
+  return dst;
+}
+
+Scalar dot_product(Vector *a, Vector *b) {
   assert(a->dims == b->dims);
-  double sum = 0.0;
+  Scalar sum = 0.0;
 
   for (int i = 0; i < a->dims; i++) {
     sum += a->arr[i] * b->arr[i];
@@ -190,7 +213,7 @@ double dot_product(Vector *a, Vector *b) {
   return sum;
 }
 
-double l2_norm(Vector *a) { return sqrt(dot_product(a, a)); }
+Scalar l2_norm(Vector *a) { return sqrt(dot_product(a, a)); }
 
 bool vector_equals(Vector *a, Vector *b) {
   assert(a->dims == b->dims);
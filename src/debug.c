@@ -75,10 +75,10 @@ void matrix_operations() {
 }
 
 void space_conversion() {
-  double c[] = {1.0, 1.0, 2.0};
-  double n[] = {-1.0, -1.0, -1.0};
-  double v[] = {0.0, 0.0, 1.0};
-  double p[] = {1.0, -3.0, -5.0};
+  Scalar c[] = {1.0, 1.0, 2.0};
+  Scalar n[] = {-1.0, -1.0, -1.0};
+  Scalar v[] = {0.0, 0.0, 1.0};
+  Scalar p[] = {1.0, -3.0, -5.0};
   char newline[] = "\n";
   Vector C = {c, c, c + 1, c + 2, 3, POINT};
   Vector N = {n, n, n + 1, n + 2, 3, POINT};
@@ -136,11 +136,14 @@ void object_file_load() {
   printf("n_vertices = %d | n_triangles = %d\n", object->n_vertices,
          object->n_triangles);
 
+  Vector *vertex = get_vertex(object, 0, NULL);
   printf("First vertex: ");
-  print_vector(object->vertices, newline);
+  print_vector(vertex, newline);
 
+  get_vertex(object, object->n_vertices - 1, vertex);
   printf("Last vertex: ");
-  print_vector(object->vertices + object->n_vertices - 1, newline);
+  print_vector(vertex, newline);
+  destroy_vector(vertex);
 
   printf("===================\n");
   destroy_object(object);
@@ -150,24 +153,30 @@ void light_file_load() {
   Light *light = load_light("data/light/basic.lux");
   char *newline = "\n";
   printf("======= Light Parameter Loading =======\n");
-  printf("eta = %f, ka = %f, ks = %f\n", light->eta, light->ka, light->ks);
+  printf("eta = %f, ka = %f, ks = %f\n", light->material->eta, light->ka,
+         light->material->ks);
 
   printf("Kd: ");
-  print_vector(light->kd, newline);
+  print_vector(light->material->kd, newline);
 
   printf("Od: ");
-  print_vector(light->od, newline);
-
-  printf("Pl: ");
-  print_vector(light->pl, newline);
+  print_vector(light->material->od, newline);
 
   printf("Ambient Color = ");
   printf("R: %d, G: %d, B: %d, A: %d\n", light->ambient.r, light->ambient.g,
          light->ambient.b, light->ambient.a);
 
-  printf("Local Color = ");
-  printf("R: %d, G: %d, B: %d, A: %d\n", light->local.r, light->local.g,
-         light->local.b, light->local.a);
+  for (int i = 0; i < light->n_sources; i++) {
+    LightSource *source = light->sources + i;
+    printf("Source %d (%s, radius = %f): ", i,
+           source->type == POINT_LIGHT ? "point" : "directional",
+           source->radius);
+    print_vector(source->pl, newline);
+
+    printf("Local Color = ");
+    printf("R: %d, G: %d, B: %d, A: %d\n", source->local.r, source->local.g,
+           source->local.b, source->local.a);
+  }
 
   printf("===================\n");
   destroy_light(light);
@@ -179,8 +188,8 @@ void barycentric_coordinates() {
   Vector *v2 = create_vector(2, POINT, 5.0, 3.0);
   Vector *v3 = create_vector(2, POINT, 2.0, 4.0);
   Vector *P = create_vector(2, POINT, 3.0, 3.0);
-  Vector *triangle[3] = {v1, v2, v3};
-  RenderTriangle t = {NULL, NULL, NULL, NULL, triangle};
+  Scalar window[3][2] = {{3.0, 2.0}, {5.0, 3.0}, {2.0, 4.0}};
+  RenderTriangles t = {1, NULL, window};
   printf("Triangle:\n");
   print_vector(v1, "\n");
   print_vector(v2, "\n");
@@ -188,7 +197,7 @@ void barycentric_coordinates() {
   printf("P: ");
   print_vector(P, "\n");
 
-  BarycentricCoordinates coords = get_bcoordinates_from_window(P, &t);
+  BarycentricCoordinates coords = get_bcoordinates_from_window(P, &t, 0);
   printf("alpha=%f, beta=%f, gamma=%f\n", coords.alpha, coords.beta,
          coords.gamma);
   printf("===================\n");
@@ -4,88 +4,474 @@
 #include "rendering/scanline.h"
 #include <SDL.h>
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+// Default downscale factor of the preview frames, which
+//    have 1 / (scale * scale) of the pixels
+#define PREVIEW_SCALE 4
+
+// Interactive navigation: default target frame rate,
+//    coarsest downscale factor used to hold it, and
+//    delay (in seconds) after the last motion before
+//    rendering the full quality frame
+#define TARGET_FPS 30
+#define MAX_MOTION_SCALE 8
+#define REFINE_DELAY 0.15
+
+// Sensitivity of the navigation controls
+#define ORBIT_DEGREES_PER_PIXEL 0.3
+#define ORBIT_DEGREES_PER_KEY 5.0
+#define PAN_PER_KEY 0.05
+#define DOLLY_PER_STEP 0.9
+
+// State shared by the UI thread and the render thread
 typedef struct {
+  char *camera_name, *object_name, *light_name;
+  int width, height, preview_scale;
+  SDL_PixelFormat *format;
+
+  // Protects every field below, except for latest
+  SDL_mutex *lock;
+  SDL_cond *wakeup;
+
+  // Requests are numbered in order. The render thread
+  //    works on the newest one and any older refinement
+  //    in progress is cancelled
+  int requested;
+  SDL_atomic_t latest;
+  RenderOptions options;
+  bool reload, changed, quit;
+
+  // Navigation: the camera being driven by the user and
+  //    the point it orbits around (NULL until the scene is
+  //    loaded), whether it moved since the last frame and
+  //    when it last moved
   Camera *camera;
-  Object *object;
-  Light *light;
-  SpaceConverter *cvt;
-} Scene;
-
-void destroy_scene(Scene *scene) {
-  destroy_object(scene->object);
-  destroy_light(scene->light);
-  destroy_converter(scene->cvt, false);
-  free(scene);
-}
+  Vector *target;
+  bool moved;
+  double last_motion;
 
-Scene *load_scene(char *camera_name, char *object_name, char *light_name) {
-  Scene *scene = (Scene *)malloc(sizeof(Scene));
-  scene->camera = load_camera(camera_name);
-  scene->object = load_object(object_name);
-  scene->light = load_light(light_name);
-  scene->cvt = get_converter(scene->camera);
-  return scene;
-}
+  // Double buffering: the render thread paints the back
+  //    buffer and swaps it with the front buffer, which
+  //    the UI thread presents
+  Uint32 *buffers[2];
+  int front;
+  bool ready;
+
+  // Only used by the render thread
+  Scene *scene;
+  FrameStats stats;
+  FILE *stats_file;
+  double budget;
+} Renderer;
+
+// Frame being produced by the render thread
+typedef struct {
+  Renderer *renderer;
+  int request;
+} Job;
 
 void draw(Uint32 *buffer, Color **canvas, SDL_PixelFormat *format, int width,
-          int height) {
+          int height, int scale) {
+  // The canvas has (width / scale) x (height / scale)
+  //    pixels, each one drawn as a scale x scale block
+  int max_y = height / scale - 1;
+  int max_x = width / scale - 1;
   for (int y = 0; y < height; y++) {
     for (int x = 0; x < width; x++) {
       int offset = y * width + x;
-      Color c = canvas[y][x];
+      Color c = canvas[SDL_min(y / scale, max_y)][SDL_min(x / scale, max_x)];
       Uint32 color = SDL_MapRGBA(format, c.r, c.g, c.b, c.a);
       buffer[offset] = color;
     }
   }
 }
 
-void reload(char *camera_name, char *object_name, char *light_name, int width,
-            int height, Scene **scene, Color ***canvas, SDL_Surface *surface,
-            Uint32 *buffer) {
-  if (*scene != NULL) {
+bool is_outdated(void *data) {
+  // A newer request arrived (or the viewer is closing)
+  Job *job = (Job *)data;
+  return SDL_AtomicGet(&job->renderer->latest) != job->request;
+}
+
+void publish(Renderer *r, Color **canvas, int scale) {
+  // Paint the back buffer, then swap it with
+  //    the front one
+  draw(r->buffers[1 - r->front], canvas, r->format, r->width, r->height,
+       scale);
+  SDL_LockMutex(r->lock);
+  r->front = 1 - r->front;
+  r->ready = true;
+  SDL_UnlockMutex(r->lock);
+}
+
+void post_request(Renderer *r) {
+  // Must be called with the lock held
+  r->requested++;
+  SDL_AtomicSet(&r->latest, r->requested);
+  SDL_CondSignal(r->wakeup);
+}
+
+void request_reload(Renderer *r) {
+  SDL_LockMutex(r->lock);
+  r->reload = true;
+  post_request(r);
+  SDL_UnlockMutex(r->lock);
+}
+
+void request_render(Renderer *r) {
+  // The options changed, so the current scene is
+  //    rendered again from the current camera
+  SDL_LockMutex(r->lock);
+  r->changed = true;
+  post_request(r);
+  SDL_UnlockMutex(r->lock);
+}
+
+void navigate(Renderer *r, double yaw, double pitch, double dx, double dy,
+              double dolly) {
+  SDL_LockMutex(r->lock);
+  if (r->camera != NULL) {
+    orbit_camera(r->camera, r->target, yaw, pitch);
+    pan_camera(r->camera, r->target, dx, dy);
+    dolly_camera(r->camera, r->target, dolly);
+    r->moved = true;
+    r->last_motion = now_seconds();
+    post_request(r);
+  }
+  SDL_UnlockMutex(r->lock);
+}
+
+void load(Renderer *r) {
+  if (r->scene != NULL) {
     // Destroy previously scene
-    destroy_scene(*scene);
+    destroy_scene(r->scene);
     printf("[main] Cena anterior removida da memória.\n");
   }
 
-  if (*canvas != NULL) {
-    // Destroy previously allocated
-    //  canvas
-    destroy_canvas(*canvas, width, height);
-    printf("[main] Rasterização anterior removida da memória.\n");
+  // Clusters belong to the meshes of the old scene
+  if (r->options.occlusion != NULL) {
+    reset_occlusion_culling(r->options.occlusion);
   }
 
   // Initally load the object and canvas
-  *scene = load_scene(camera_name, object_name, light_name);
+  reset_stats(&r->stats);
+  begin_stage(&r->stats, STAGE_LOAD);
+  r->scene = load_scene(r->camera_name, r->object_name, r->light_name);
+  end_stage(&r->stats, STAGE_LOAD);
   printf("[main] Cena carregada com sucesso.\n");
 
-  *canvas = rasterize((*scene)->object, (*scene)->light, (*scene)->cvt, width,
-                      height);
+  // Navigation starts from the loaded camera, orbiting
+  //    around the point of its view direction that's
+  //    closest to the center of the scene
+  Camera *camera = copy_camera(r->scene->camera);
+  Vector *target = orbit_target(r->scene);
+
+  SDL_LockMutex(r->lock);
+  if (r->camera != NULL) {
+    destroy_camera(r->camera);
+    destroy_vector(r->target);
+  }
+  r->camera = camera;
+  r->target = target;
+  r->moved = false;
+  SDL_UnlockMutex(r->lock);
+}
+
+void render_full(Renderer *r, RenderOptions *options, bool preview) {
+  double start = now_seconds();
+  int width = r->width, height = r->height;
+
+  // Progressive rendering: a low resolution preview
+  //    is presented right away and then refined. The
+  //    preview is a frame of its own in the stats (along
+  //    with the scene loading), and it's cancelled just
+  //    like the refinement
+  int preview_w = width / r->preview_scale;
+  int preview_h = height / r->preview_scale;
+  if (preview && r->preview_scale > 1 && preview_w > 0 && preview_h > 0) {
+    RenderOptions preview_options = *options;
+    preview_options.samples = 1;
+    Color **canvas = rasterize(r->scene, preview_w, preview_h,
+                               &preview_options, &r->stats);
+    if (canvas == NULL) {
+      printf("[main] Prévia cancelada.\n");
+      return;
+    }
+
+    begin_stage(&r->stats, STAGE_PRESENT);
+    publish(r, canvas, r->preview_scale);
+    end_stage(&r->stats, STAGE_PRESENT);
+    destroy_canvas(canvas, preview_w, preview_h);
+    printf("[main] Prévia apresentada em %.3f s.\n", now_seconds() - start);
+
+    if (r->stats_file != NULL) {
+      write_stats_json(&r->stats, r->stats_file);
+    }
+    reset_stats(&r->stats);
+  }
+
+  Color **canvas = rasterize(r->scene, width, height, options, &r->stats);
+  if (canvas == NULL) {
+    // A newer request arrived, keep the preview
+    printf("[main] Refinamento cancelado.\n");
+    return;
+  }
   printf("[main] Rasterização finalizada com sucesso.\n");
 
   // Paint surface
-  SDL_LockSurface(surface);
-  draw(buffer, *canvas, surface->format, width, height);
-  SDL_UnlockSurface(surface);
+  begin_stage(&r->stats, STAGE_PRESENT);
+  publish(r, canvas, 1);
+  end_stage(&r->stats, STAGE_PRESENT);
+  destroy_canvas(canvas, width, height);
+  printf("[main] Quadro %d finalizado em %.3f s.\n", r->stats.frame,
+         total_time(&r->stats));
+
+  if (r->stats_file != NULL) {
+    write_stats_json(&r->stats, r->stats_file);
+  }
+}
+
+void render_motion(Renderer *r, RenderOptions *options, int *scale) {
+  // Frames rendered while the camera moves use a single
+  //    sample and are never cancelled, so that they keep
+  //    coming. Their resolution is lowered to hold the
+  //    frame-time budget
+  int width = SDL_max(1, r->width / *scale);
+  int height = SDL_max(1, r->height / *scale);
+  RenderOptions motion_options = *options;
+  motion_options.samples = 1;
+  motion_options.cancel = NULL;
+  motion_options.cancel_data = NULL;
+  reset_stats(&r->stats);
+  Color **canvas =
+      rasterize(r->scene, width, height, &motion_options, &r->stats);
+  begin_stage(&r->stats, STAGE_PRESENT);
+  publish(r, canvas, *scale);
+  end_stage(&r->stats, STAGE_PRESENT);
+  destroy_canvas(canvas, width, height);
+
+  if (r->stats_file != NULL) {
+    write_stats_json(&r->stats, r->stats_file);
+  }
+
+  // Only rasterization and shading are proportional to
+  //    the number of pixels, while the geometry stages
+  //    and presenting (at full size) don't depend on the
+  //    scale, so the next finer scale is only taken if
+  //    its predicted cost fits the budget
+  double elapsed = total_time(&r->stats);
+  double per_pixel = r->stats.time[STAGE_RASTER] + r->stats.time[STAGE_SHADE];
+  int max_scale = SDL_min(MAX_MOTION_SCALE, SDL_min(r->width, r->height));
+  if (elapsed > r->budget && *scale < max_scale) {
+    (*scale)++;
+  } else if (*scale > 1) {
+    double finer = (double)(*scale * *scale) / ((*scale - 1) * (*scale - 1));
+    double predicted = elapsed + per_pixel * (finer - 1.0);
+    *scale -= (predicted < r->budget) ? 1 : 0;
+  }
+}
+
+int render_thread(void *data) {
+  Renderer *r = (Renderer *)data;
+  int handled = 0, scale = 1;
+  bool refine = false;
+
+  while (true) {
+    // Wait for a request newer than the last one or,
+    //    after the camera stops, for the refinement delay
+    SDL_LockMutex(r->lock);
+    while (!r->quit && r->requested == handled) {
+      if (!refine) {
+        SDL_CondWait(r->wakeup, r->lock);
+        continue;
+      }
+
+      double still = now_seconds() - r->last_motion;
+      if (still >= REFINE_DELAY) {
+        break;
+      }
+      SDL_CondWaitTimeout(r->wakeup, r->lock,
+                          (Uint32)((REFINE_DELAY - still) * 1e3) + 1);
+    }
+
+    if (r->quit) {
+      SDL_UnlockMutex(r->lock);
+      break;
+    }
+
+    bool reload = r->reload;
+    bool moved = r->moved && r->scene != NULL;
+    bool changed = r->changed && r->scene != NULL;
+    Camera *camera = moved ? copy_camera(r->camera) : NULL;
+    r->reload = false;
+    r->moved = false;
+    r->changed = false;
+    handled = r->requested;
+    Job job = {r, handled};
+    RenderOptions options = r->options;
+    SDL_UnlockMutex(r->lock);
+
+    options.cancel = is_outdated;
+    options.cancel_data = &job;
+    if (reload) {
+      printf("[main] === Recarregando cena ===\n");
+      load(r);
+      render_full(r, &options, true);
+      printf("[main] === Cena recarregada ===\n");
+      refine = false;
+      if (camera != NULL) {
+        destroy_camera(camera);
+      }
+    } else if (moved) {
+      // The refinement after the motion also
+      //    takes any changed options
+      set_scene_camera(r->scene, camera);
+      render_motion(r, &options, &scale);
+      refine = true;
+    } else if (changed) {
+      reset_stats(&r->stats);
+      render_full(r, &options, true);
+      refine = false;
+    } else if (refine) {
+      reset_stats(&r->stats);
+      render_full(r, &options, false);
+      refine = false;
+    }
+  }
+
+  return 0;
+}
+
+void handle_navigation(Renderer *r, SDL_Event *event) {
+  // Left button orbits, the other buttons pan and
+  //    the wheel dollies. Arrows orbit (or pan, with
+  //    shift) and +/- dolly
+  if (event->type == SDL_MOUSEMOTION) {
+    double dx = event->motion.xrel, dy = event->motion.yrel;
+    if (event->motion.state & SDL_BUTTON_LMASK) {
+      navigate(r, -dx * ORBIT_DEGREES_PER_PIXEL,
+               -dy * ORBIT_DEGREES_PER_PIXEL, 0.0, 0.0, 1.0);
+    } else if (event->motion.state & (SDL_BUTTON_MMASK | SDL_BUTTON_RMASK)) {
+      navigate(r, 0.0, 0.0, -2.0 * dx / r->width, 2.0 * dy / r->height, 1.0);
+    }
+  } else if (event->type == SDL_MOUSEWHEEL && event->wheel.y != 0) {
+    navigate(r, 0.0, 0.0, 0.0, 0.0, pow(DOLLY_PER_STEP, event->wheel.y));
+  } else if (event->type == SDL_KEYDOWN) {
+    bool shift = SDL_GetModState() & KMOD_SHIFT;
+    double step = shift ? PAN_PER_KEY : ORBIT_DEGREES_PER_KEY;
+    double x = 0.0, y = 0.0, dolly = 1.0;
+    switch (event->key.keysym.sym) {
+    case SDLK_LEFT:
+      x = step;
+      break;
+    case SDLK_RIGHT:
+      x = -step;
+      break;
+    case SDLK_UP:
+      y = step;
+      break;
+    case SDLK_DOWN:
+      y = -step;
+      break;
+    case SDLK_PLUS:
+    case SDLK_EQUALS:
+      dolly = DOLLY_PER_STEP;
+      break;
+    case SDLK_MINUS:
+      dolly = 1.0 / DOLLY_PER_STEP;
+      break;
+    default:
+      return;
+    }
+
+    if (shift) {
+      navigate(r, 0.0, 0.0, -x, y, dolly);
+    } else {
+      navigate(r, x, y, 0.0, 0.0, dolly);
+    }
+  }
 }
 
 int main(int argc, char *argv[]) {
   assert(argc == 4 || argc == 6);
   SDL_Window *window;
   SDL_Surface *surface, *win_surface;
+  SDL_Thread *thread;
   SDL_Event event;
-  Scene *scene = NULL;
-  Color **canvas = NULL;
-  int width = 600;
-  int height = 600;
-  Uint32 *buffer, color;
+  Renderer r = {argv[1], argv[2], argv[3], 600, 600, PREVIEW_SCALE};
+  r.options = default_render_options();
+  r.budget = 1.0 / TARGET_FPS;
 
   if (argc == 6) {
-    width = atoi(argv[4]);
-    height = atoi(argv[5]);
+    r.width = atoi(argv[4]);
+    r.height = atoi(argv[5]);
+  }
+
+  // Optionally, dump the stats of each frame
+  //    as JSON lines
+  if (getenv("CG_STATS_JSON") != NULL) {
+    r.stats_file = fopen(getenv("CG_STATS_JSON"), "a");
+    assert(r.stats_file != NULL);
+  }
+
+  // Optionally, set the number of samples
+  //    per pixel (anti-aliasing)
+  if (getenv("CG_MSAA") != NULL) {
+    r.options.samples = atoi(getenv("CG_MSAA"));
+  }
+
+  // Optionally, start in an unshaded render
+  //    mode (wireframe or points)
+  if (getenv("CG_RENDER_MODE") != NULL &&
+      !parse_render_mode(getenv("CG_RENDER_MODE"), &r.options.mode)) {
+    printf("[main] Modo de renderização desconhecido: %s\n",
+           getenv("CG_RENDER_MODE"));
+  }
+
+  // Optionally, light each vertex instead of
+  //    each pixel (Gouraud shading)
+  if (getenv("CG_SHADING") != NULL &&
+      !parse_shading_model(getenv("CG_SHADING"), &r.options.shading)) {
+    printf("[main] Modelo de tonalização desconhecido: %s\n",
+           getenv("CG_SHADING"));
+  }
+
+  // Parallel stages run on one worker per core,
+  //    unless the number of workers is set (1
+  //    renders serially)
+  int workers = (getenv("CG_WORKERS") != NULL) ? atoi(getenv("CG_WORKERS")) : 0;
+  r.options.scheduler = create_scheduler(workers);
+  printf("[main] Renderizando com %d worker(s).\n",
+         scheduler_workers(r.options.scheduler));
+
+  // Optionally, cull clusters hidden by the ones
+  //    drawn in the previous frame
+  if (getenv("CG_OCCLUSION") != NULL && atoi(getenv("CG_OCCLUSION")) != 0) {
+    r.options.occlusion = create_occlusion_culling();
+    printf("[main] Oclusão de clusters habilitada.\n");
+  }
+
+  // Optionally, skip meshlets outside the frustum
+  //    or facing away from the camera
+  if (getenv("CG_MESHLETS") != NULL && atoi(getenv("CG_MESHLETS")) != 0) {
+    r.options.cull_meshlets = true;
+    printf("[main] Descarte de meshlets habilitado.\n");
+  }
+
+  // Optionally, change the downscale factor of
+  //    the preview (1 disables it)
+  if (getenv("CG_PREVIEW") != NULL) {
+    r.preview_scale = atoi(getenv("CG_PREVIEW"));
+  }
+
+  // Optionally, change the target frame rate
+  //    while navigating
+  if (getenv("CG_TARGET_FPS") != NULL) {
+    r.budget = 1.0 / atof(getenv("CG_TARGET_FPS"));
   }
 
   // Init SDL video
@@ -94,16 +480,23 @@ int main(int argc, char *argv[]) {
   // Create window and renderer
   printf("[main] Configurando janela e superfície.\n");
   window = SDL_CreateWindow("Scanline Rendering", SDL_WINDOWPOS_UNDEFINED,
-                            SDL_WINDOWPOS_UNDEFINED, width, height, 0);
+                            SDL_WINDOWPOS_UNDEFINED, r.width, r.height, 0);
   win_surface = SDL_GetWindowSurface(window);
-  surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32,
+  surface = SDL_CreateRGBSurfaceWithFormat(0, r.width, r.height, 32,
                                            SDL_PIXELFORMAT_RGBA32);
-  buffer = (Uint32 *)surface->pixels;
+  size_t buffer_size = (size_t)r.width * r.height * sizeof(Uint32);
+  r.format = surface->format;
+  r.buffers[0] = (Uint32 *)calloc(1, buffer_size);
+  r.buffers[1] = (Uint32 *)calloc(1, buffer_size);
+  assert(r.buffers[0] != NULL && r.buffers[1] != NULL);
   printf("[main] Janela e superfície configuradas.\n");
 
-  // Reload surface
-  reload(argv[1], argv[2], argv[3], width, height, &scene, &canvas, surface,
-         buffer);
+  // Start the render thread with the first frame
+  r.lock = SDL_CreateMutex();
+  r.wakeup = SDL_CreateCond();
+  thread = SDL_CreateThread(render_thread, "render", &r);
+  assert(thread != NULL);
+  request_reload(&r);
 
   // Main loop
   bool quit = false;
@@ -113,19 +506,94 @@ int main(int argc, char *argv[]) {
         quit = true;
       }
 
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_m) {
+        // Cycle among 1, 2, 4 and 8 samples per pixel
+        SDL_LockMutex(r.lock);
+        r.options.samples = (r.options.samples >= MAX_SAMPLES)
+                                ? 1
+                                : 2 * r.options.samples;
+        printf("[main] Anti-aliasing com %d amostra(s) por pixel.\n",
+               r.options.samples);
+        SDL_UnlockMutex(r.lock);
+      }
+
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_w) {
+        // Cycle among shaded, wireframe and points
+        SDL_LockMutex(r.lock);
+        r.options.mode = (r.options.mode + 1) % (RENDER_POINTS + 1);
+        printf("[main] Modo de renderização: %s.\n",
+               render_mode_name(r.options.mode));
+        SDL_UnlockMutex(r.lock);
+      }
+
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_g) {
+        // Toggle between Phong and Gouraud shading
+        SDL_LockMutex(r.lock);
+        r.options.shading = (r.options.shading == SHADING_PHONG)
+                                ? SHADING_GOURAUD
+                                : SHADING_PHONG;
+        printf("[main] Tonalização: %s.\n",
+               shading_model_name(r.options.shading));
+        SDL_UnlockMutex(r.lock);
+      }
+
       if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_r) {
-        printf("[main] === Recarregando cena ===\n");
-        reload(argv[1], argv[2], argv[3], width, height, &scene, &canvas,
-               surface, buffer);
-        printf("[main] === Cena recarregada ===\n");
+        request_reload(&r);
+      }
+
+      // Changed options keep the scene and the camera
+      if (event.type == SDL_KEYDOWN && (event.key.keysym.sym == SDLK_m ||
+                                        event.key.keysym.sym == SDLK_w ||
+                                        event.key.keysym.sym == SDLK_g)) {
+        request_render(&r);
       }
+
+      handle_navigation(&r, &event);
+    }
+
+    // Present the newest complete frame
+    SDL_LockMutex(r.lock);
+    if (r.ready) {
+      SDL_LockSurface(surface);
+      memcpy(surface->pixels, r.buffers[r.front], buffer_size);
+      SDL_UnlockSurface(surface);
+      r.ready = false;
     }
+    SDL_UnlockMutex(r.lock);
 
     SDL_BlitSurface(surface, 0, win_surface, 0);
     SDL_UpdateWindowSurface(window);
     SDL_Delay(10);
   }
+
+  // Cancel the current frame and stop the render thread
+  SDL_LockMutex(r.lock);
+  r.quit = true;
+  SDL_AtomicSet(&r.latest, -1);
+  SDL_CondSignal(r.wakeup);
+  SDL_UnlockMutex(r.lock);
+  SDL_WaitThread(thread, NULL);
+  SDL_DestroyCond(r.wakeup);
+  SDL_DestroyMutex(r.lock);
+
+  // Cleanup
+  if (r.scene != NULL) {
+    destroy_scene(r.scene);
+    destroy_camera(r.camera);
+    destroy_vector(r.target);
+  }
+  destroy_scheduler(r.options.scheduler);
+  if (r.options.occlusion != NULL) {
+    destroy_occlusion_culling(r.options.occlusion);
+  }
+  free(r.buffers[0]);
+  free(r.buffers[1]);
+  SDL_FreeSurface(surface);
   SDL_Quit();
 
+  if (r.stats_file != NULL) {
+    fclose(r.stats_file);
+  }
+
   return 0;
 }
@@ -0,0 +1,135 @@
+#include "binning.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Data shared by the tasks (chunks) of both passes
+typedef struct {
+  TriangleBins *bins;
+  BoundingBox *boxes;
+  int n, chunk_size, n_tiles;
+
+  // Row of counts (then positions) of each chunk
+  int *cursor;
+} BinningJob;
+
+// Range of tiles overlapped by a bounding box,
+//    false if the box is empty
+bool box_tiles(TriangleBins *bins, BoundingBox *box, int range[4]);
+
+// Passes, where each task is a chunk
+void count_chunk(void *data, int c, int worker);
+void fill_chunk(void *data, int c, int worker);
+
+bool box_tiles(TriangleBins *bins, BoundingBox *box, int range[4]) {
+  if (box->min_x > box->max_x || box->min_y > box->max_y) {
+    return false;
+  }
+
+  range[0] = box->min_x / bins->tile_size;
+  range[1] = box->min_y / bins->tile_size;
+  range[2] = box->max_x / bins->tile_size;
+  range[3] = box->max_y / bins->tile_size;
+  return true;
+}
+
+TriangleBins *bin_primitives(BoundingBox *boxes, int n, int width, int height,
+                             int tile_size, int n_chunks,
+                             TaskScheduler *scheduler) {
+  TriangleBins *bins = (TriangleBins *)malloc(sizeof(TriangleBins));
+  assert(bins != NULL && n_chunks > 0);
+  bins->tile_size = tile_size;
+  bins->tiles_x = (width + tile_size - 1) / tile_size;
+  bins->tiles_y = (height + tile_size - 1) / tile_size;
+  int n_tiles = bins->tiles_x * bins->tiles_y;
+  BinningJob job = {bins, boxes, n, (n + n_chunks - 1) / n_chunks, n_tiles};
+
+  // Count, for each chunk, how many of its
+  //    primitives overlap each tile. Chunks only
+  //    write to their own row of counts
+  job.cursor = (int *)calloc((long)n_chunks * n_tiles, sizeof(int));
+  assert(job.cursor != NULL);
+  parallel_for(scheduler, n_chunks, count_chunk, &job);
+
+  // Prefix sum in tile-major, chunk-minor order, so
+  //    that the counts become the position where each
+  //    chunk starts writing in each tile
+  int *cursor = job.cursor;
+  bins->offsets = (int *)malloc((n_tiles + 1) * sizeof(int));
+  int total = 0;
+  for (int t = 0; t < n_tiles; t++) {
+    bins->offsets[t] = total;
+    for (int c = 0; c < n_chunks; c++) {
+      int count = cursor[(long)c * n_tiles + t];
+      cursor[(long)c * n_tiles + t] = total;
+      total += count;
+    }
+  }
+  bins->offsets[n_tiles] = total;
+
+  // Fill the lists. Every chunk writes to its own
+  //    disjoint ranges, in submission order
+  bins->indices = (uint32_t *)malloc((total + 1) * sizeof(uint32_t));
+  assert(bins->offsets != NULL && bins->indices != NULL);
+  parallel_for(scheduler, n_chunks, fill_chunk, &job);
+
+  // Cleanup
+  free(cursor);
+  return bins;
+}
+
+void count_chunk(void *data, int c, int worker) {
+  BinningJob *job = (BinningJob *)data;
+  TriangleBins *bins = job->bins;
+  int *counts = job->cursor + (long)c * job->n_tiles;
+  int start = c * job->chunk_size;
+  int end =
+      (start + job->chunk_size < job->n) ? start + job->chunk_size : job->n;
+  for (int k = start; k < end; k++) {
+    int range[4];
+    if (!box_tiles(bins, job->boxes + k, range)) {
+      continue;
+    }
+
+    for (int ty = range[1]; ty <= range[3]; ty++) {
+      for (int tx = range[0]; tx <= range[2]; tx++) {
+        counts[ty * bins->tiles_x + tx]++;
+      }
+    }
+  }
+}
+
+void fill_chunk(void *data, int c, int worker) {
+  BinningJob *job = (BinningJob *)data;
+  TriangleBins *bins = job->bins;
+  int *positions = job->cursor + (long)c * job->n_tiles;
+  int start = c * job->chunk_size;
+  int end =
+      (start + job->chunk_size < job->n) ? start + job->chunk_size : job->n;
+  for (int k = start; k < end; k++) {
+    int range[4];
+    if (!box_tiles(bins, job->boxes + k, range)) {
+      continue;
+    }
+
+    for (int ty = range[1]; ty <= range[3]; ty++) {
+      for (int tx = range[0]; tx <= range[2]; tx++) {
+        bins->indices[positions[ty * bins->tiles_x + tx]++] = k;
+      }
+    }
+  }
+}
+
+void tile_bounds(TriangleBins *bins, int t, int width, int height, int *x0,
+                 int *y0, int *x1, int *y1) {
+  *x0 = (t % bins->tiles_x) * bins->tile_size;
+  *y0 = (t / bins->tiles_x) * bins->tile_size;
+  *x1 = (*x0 + bins->tile_size < width) ? *x0 + bins->tile_size : width;
+  *y1 = (*y0 + bins->tile_size < height) ? *y0 + bins->tile_size : height;
+}
+
+void destroy_triangle_bins(TriangleBins *bins) {
+  free(bins->offsets);
+  free(bins->indices);
+  free(bins);
+}
@@ -0,0 +1,42 @@
+#ifndef RENDERING_BINNING
+#define RENDERING_BINNING
+#include "scheduler.h"
+#include <stdint.h>
+
+typedef struct {
+  // Inclusive range of pixels covered by a primitive,
+  //    empty if min_x > max_x
+  int min_x, min_y, max_x, max_y;
+} BoundingBox;
+
+typedef struct {
+  int tile_size, tiles_x, tiles_y;
+
+  // Primitives that overlap the tile t, in submission
+  //    order, are indices[offsets[t]:offsets[t + 1]]
+  int *offsets;
+  uint32_t *indices;
+} TriangleBins;
+
+/*
+ * Assign each primitive, given by its bounding box in
+ * window space, to the screen tiles it overlaps. The
+ * primitives are split into n_chunks contiguous ranges
+ * that are binned independently (as tasks of the
+ * scheduler, if any) and merged without locks, so that
+ * each tile lists its primitives in submission order.
+ * */
+TriangleBins *bin_primitives(BoundingBox *boxes, int n, int width, int height,
+                             int tile_size, int n_chunks,
+                             TaskScheduler *scheduler);
+
+/*
+ * Obtain the pixels [x0, x1) x [y0, y1) of the tile t
+ * of a window with the given size.
+ * */
+void tile_bounds(TriangleBins *bins, int t, int width, int height, int *x0,
+                 int *y0, int *x1, int *y1);
+
+void destroy_triangle_bins(TriangleBins *bins);
+
+#endif
@@ -2,154 +2,244 @@
 #include "math_utils.h"
 #include <assert.h>
 #include <math.h>
-#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Data shared by the tasks of an instance
+typedef struct {
+  Instance *instance;
+  SpaceConverter *cvt;
+  int width, height;
+
+  // Every vertex of the mesh
+  InstanceVertices *vertices;
+
+  // Every triangle of the mesh: its normal and
+  //    whether it's valid
+  Scalar (*face_normals)[3];
+  bool *valid;
+
+  // Triangles of the mesh being gathered (all of
+  //    them if subset is NULL)
+  RenderTriangles *triangles;
+  int *subset;
+  int n_triangles;
+} EntitiesJob;
+
+// Tasks, each one processes a range of vertices
+//    or triangles
+void transform_vertex_range(void *data, int task, int worker);
+void face_normal_range(void *data, int task, int worker);
+void vertex_normal_range(void *data, int task, int worker);
+void gather_triangle_range(void *data, int task, int worker);
+
+// Normal utilities
+void normalize_normal(Scalar *normal);
 
 // Construction
-RenderTriangle *triangles_from_world_object(Object *world_object,
-                                            SpaceConverter *cvt, int width,
-                                            int height) {
-  printf("[scanline/entities] Iniciando carregamento dos triângulos de "
-         "renderização.\n");
-  int n_triangles = world_object->n_triangles;
-  int n_vertices = world_object->n_vertices;
-  RenderTriangle *T = malloc(n_triangles * sizeof(RenderTriangle));
-
-  // Holds the normal for the i-th triangle
-  Vector **triangle_normals = malloc(n_triangles * sizeof(Vector *));
-
-  // We convert each triangle in the original
-  //    object. Note that the vertices in camera,
-  //    projection and window space won't share the
-  //    same address among the RenderTriangles.
-  for (int i = 0; i < n_triangles; i++) {
-    // Obtain current triangles
-    Triangle *object_t = world_object->triangles + i;
-    RenderTriangle *ti = T + i;
-
-    // Dynamic allocate array of 3 pointers
-    ti->world = malloc(3 * sizeof(Vector *));
-    ti->camera = malloc(3 * sizeof(Vector *));
-    ti->camera_normals = malloc(3 * sizeof(Vector *));
-    ti->projection = malloc(3 * sizeof(Vector *));
-    ti->window = malloc(3 * sizeof(Vector *));
-
-    // Set values in RenderTriangle
-    for (int j = 0; j < 3; j++) {
-      // Obtain object vertex
-      Vector *vertex = NULL;
-      switch (j) {
-      case 0:
-        vertex = object_t->v1;
-        break;
-      case 1:
-        vertex = object_t->v2;
-        break;
-      default:
-        vertex = object_t->v3;
-        break;
-      }
+InstanceVertices *transform_instance(Instance *instance, SpaceConverter *cvt,
+                                     int width, int height, bool normals,
+                                     TaskScheduler *scheduler,
+                                     FrameStats *stats) {
+  Object *mesh = instance->mesh;
+  InstanceVertices *vertices =
+      (InstanceVertices *)malloc(sizeof(InstanceVertices));
+  assert(vertices != NULL);
+  vertices->instance = instance;
+  vertices->window =
+      (Scalar(*)[2])malloc(mesh->n_vertices * sizeof(*vertices->window));
+  vertices->camera =
+      (Scalar(*)[3])malloc(mesh->n_vertices * sizeof(*vertices->camera));
+  vertices->normals = NULL;
+  assert(vertices->window != NULL && vertices->camera != NULL);
+
+  // Transform each vertex of the mesh once, since
+  //    they're shared by several triangles
+  EntitiesJob job = {instance, cvt, width, height, vertices};
+  begin_stage(stats, STAGE_TRANSFORM);
+  parallel_for(scheduler, count_tasks(mesh->n_vertices),
+               transform_vertex_range, &job);
+  end_stage(stats, STAGE_TRANSFORM);
+
+  if (normals) {
+    // Vertex normals average the normals of the valid
+    //    triangles of the whole mesh using the vertex,
+    //    so they don't depend on the triangles drawn
+    begin_stage(stats, STAGE_NORMALS);
+    job.face_normals =
+        (Scalar(*)[3])malloc(mesh->n_triangles * sizeof(Scalar[3]));
+    job.valid = (bool *)malloc(mesh->n_triangles * sizeof(bool));
+    vertices->normals =
+        (Scalar(*)[3])malloc(mesh->n_vertices * sizeof(*vertices->normals));
+    assert(job.face_normals != NULL && job.valid != NULL &&
+           vertices->normals != NULL);
+    parallel_for(scheduler, count_tasks(mesh->n_triangles),
+                 face_normal_range, &job);
+    parallel_for(scheduler, count_tasks(mesh->n_vertices),
+                 vertex_normal_range, &job);
+    end_stage(stats, STAGE_NORMALS);
+
+    free(job.face_normals);
+    free(job.valid);
+  }
 
-      // Vertex conversions
-      Vector *c = cvt_world_to_camera(vertex, cvt);
-      Vector *p = cvt_camera_to_projection(c, cvt->camera, true);
-      Vector *w = cvt_projection_to_window(p, width, height);
+  return vertices;
+}
 
-      // Store the pointer in the correct spot
-      ti->world[j] = vertex;
-      ti->projection[j] = p;
-      ti->camera[j] = c;
-      ti->window[j] = w;
+RenderTriangles *gather_triangles(InstanceVertices *vertices, int *subset,
+                                  int n_triangles, TaskScheduler *scheduler,
+                                  FrameStats *stats) {
+  Object *mesh = vertices->instance->mesh;
+  n_triangles = (subset != NULL) ? n_triangles : mesh->n_triangles;
+
+  // One array per attribute, for every triangle
+  RenderTriangles *T = (RenderTriangles *)malloc(sizeof(RenderTriangles));
+  assert(T != NULL);
+  int n_corners = 3 * n_triangles;
+  bool normals = vertices->normals != NULL;
+  T->n_triangles = n_triangles;
+  T->vertices = (uint32_t *)malloc(n_corners * sizeof(uint32_t));
+  T->window = (Scalar(*)[2])malloc(n_corners * sizeof(*T->window));
+  T->camera = (Scalar(*)[3])malloc(n_corners * sizeof(*T->camera));
+  T->normals =
+      normals ? (Scalar(*)[3])malloc(n_corners * sizeof(*T->normals)) : NULL;
+  T->colors = NULL;
+  assert(T->vertices != NULL && T->window != NULL && T->camera != NULL);
+  assert(!normals || T->normals != NULL);
+
+  // Copy the vertices of each triangle to its corners
+  EntitiesJob job = {vertices->instance, NULL, 0, 0, vertices};
+  job.triangles = T;
+  job.subset = subset;
+  job.n_triangles = n_triangles;
+  begin_stage(stats, STAGE_TRANSFORM);
+  parallel_for(scheduler, count_tasks(n_triangles),
+               gather_triangle_range, &job);
+  end_stage(stats, STAGE_TRANSFORM);
 
-      // Vertex normal will be set afterwards
-      ti->camera_normals[j] = NULL;
-    }
+  return T;
+}
 
-    // Obtain triangle normal
-    triangle_normals[i] = sub_vector(ti->camera[2], ti->camera[0], NULL);
-    Vector *aux = sub_vector(ti->camera[1], ti->camera[0], NULL);
-    cross_product(triangle_normals[i], aux, triangle_normals[i]);
-    double norm = 1.0 / l2_norm(triangle_normals[i]);
-    scalar_mult_vector(norm, triangle_normals[i], triangle_normals[i]);
-    destroy_vector(aux);
+void transform_vertex_range(void *data, int task, int worker) {
+  EntitiesJob *job = (EntitiesJob *)data;
+  int first, last;
+  task_range(task, job->instance->mesh->n_vertices, &first, &last);
+
+  for (int v = first; v < last; v++) {
+    transform_vertex(job->instance, job->cvt, job->width, job->height, v,
+                     job->vertices->camera[v], job->vertices->window[v]);
   }
+}
 
-  printf("[scanline/entities] Calculando normais dos vértices.\n");
-  // Obtain vertex normals
-  for (int i = 0; i < n_triangles; i++) {
-    RenderTriangle *t1 = T + i;
-    if (!is_valid_triangle(t1->window[0], t1->window[1], t1->window[2])) {
+void face_normal_range(void *data, int task, int worker) {
+  EntitiesJob *job = (EntitiesJob *)data;
+  Object *mesh = job->instance->mesh;
+  int first, last;
+  task_range(task, mesh->n_triangles, &first, &last);
+
+  Scalar(*window)[2] = job->vertices->window;
+  Scalar(*camera)[3] = job->vertices->camera;
+  for (int t = first; t < last; t++) {
+    uint32_t *v = mesh->indices + 3 * t;
+
+    // Validity in window space (degenerate triangles
+    //    don't contribute to the vertex normals)
+    job->valid[t] =
+        is_valid_triangle(window[v[0]], window[v[1]], window[v[2]]);
+    if (!job->valid[t]) {
       continue;
     }
 
-    // For each vertex in this triangle
-    for (int v = 0; v < 3; v++) {
-      Vector *camera = t1->camera[v];
-
-      // Initialize normal with the current
-      //    triangle normal
-      Vector *normal = copy_vector(triangle_normals[i], NULL);
-
-      // For every RenderTriangle
-      for (int j = 0; j < n_triangles; j++) {
-        RenderTriangle *t2 = T + j;
-        bool valid_triangle =
-            is_valid_triangle(t2->window[0], t2->window[1], t2->window[2]);
-        bool same_vertex = vector_equals(camera, t2->camera[0]);
-        same_vertex = same_vertex || vector_equals(camera, t2->camera[1]);
-        same_vertex = same_vertex || vector_equals(camera, t2->camera[2]);
-        if (i != j && valid_triangle && same_vertex) {
-          // Add this triangle normal to the normal vector
-          add_vector(triangle_normals[j], normal, normal);
+    // Obtain triangle normal, (v3 - v1) x (v2 - v1)
+    Scalar *v1 = camera[v[0]], *v2 = camera[v[1]], *v3 = camera[v[2]];
+    Scalar a[3] = {v3[0] - v1[0], v3[1] - v1[1], v3[2] - v1[2]};
+    Scalar b[3] = {v2[0] - v1[0], v2[1] - v1[1], v2[2] - v1[2]};
+    Scalar *normal = job->face_normals[t];
+    normal[0] = a[1] * b[2] - a[2] * b[1];
+    normal[1] = a[2] * b[0] - a[0] * b[2];
+    normal[2] = a[0] * b[1] - a[1] * b[0];
+    normalize_normal(normal);
+  }
+}
+
+void vertex_normal_range(void *data, int task, int worker) {
+  EntitiesJob *job = (EntitiesJob *)data;
+  Object *mesh = job->instance->mesh;
+  int first, last;
+  task_range(task, mesh->n_vertices, &first, &last);
+
+  // Each task gathers the normals of the triangles
+  //    of its own vertices, in increasing order, so
+  //    the result doesn't depend on the workers
+  for (int v = first; v < last; v++) {
+    Scalar *normal = job->vertices->normals[v];
+    normal[0] = normal[1] = normal[2] = 0.0;
+    for (int k = mesh->vertex_offsets[v]; k < mesh->vertex_offsets[v + 1];
+         k++) {
+      int t = mesh->vertex_triangles[k];
+
+      // Triangles repeating the vertex are degenerate
+      //    (and thus invalid), so each one is added once
+      if (job->valid[t]) {
+        for (int l = 0; l < 3; l++) {
+          normal[l] = job->face_normals[t][l] + normal[l];
         }
       }
-
-      // Normalize the new normal
-      double norm = 1.0 / l2_norm(normal);
-      scalar_mult_vector(norm, normal, normal);
-
-      // Set triangle normal for this vertex
-      t1->camera_normals[v] = normal;
     }
-  }
 
-  // Cleanup
-  for (int i = 0; i < n_triangles; i++) {
-    destroy_vector(triangle_normals[i]);
+    // Vertices of invalid triangles only are
+    //    never shaded
+    if (normal[0] != 0.0 || normal[1] != 0.0 || normal[2] != 0.0) {
+      normalize_normal(normal);
+    }
   }
-  free(triangle_normals);
-
-  printf("[scanline/entities] Triângulos de renderização carregados.\n");
-  return T;
 }
 
-// Destruction
-void destroy_render_triangles(RenderTriangle *triangles, int n_triangles) {
-  // Clear each triangle
-  for (int i = 0; i < n_triangles; i++) {
-    RenderTriangle *ti = triangles + i;
-
-    // Destroy vectors
-    for (int j = 0; j < 3; j++) {
-      destroy_vector(ti->camera[j]);
-      destroy_vector(ti->window[j]);
-      destroy_vector(ti->projection[j]);
-      if (ti->camera_normals[j] != NULL) {
-        // Some RenderTriangles might not be
-        // actual triangles (e.g., liines)
-        // and won't have a normal
-        destroy_vector(ti->camera_normals[j]);
+void gather_triangle_range(void *data, int task, int worker) {
+  EntitiesJob *job = (EntitiesJob *)data;
+  Object *mesh = job->instance->mesh;
+  InstanceVertices *vertices = job->vertices;
+  RenderTriangles *T = job->triangles;
+  int first, last;
+  task_range(task, job->n_triangles, &first, &last);
+
+  for (int i = first; i < last; i++) {
+    int index = (job->subset != NULL) ? job->subset[i] : i;
+    for (int k = 0; k < 3; k++) {
+      int corner = 3 * i + k;
+      uint32_t v = mesh->indices[3 * index + k];
+      T->vertices[corner] = v;
+      memcpy(T->camera[corner], vertices->camera[v], sizeof(Scalar[3]));
+      memcpy(T->window[corner], vertices->window[v], sizeof(Scalar[2]));
+      if (T->normals != NULL) {
+        memcpy(T->normals[corner], vertices->normals[v], sizeof(Scalar[3]));
       }
     }
+  }
+}
 
-    // Free pointers of pointers
-    free(ti->camera);
-    free(ti->camera_normals);
-    free(ti->world);
-    free(ti->projection);
-    free(ti->window);
+void normalize_normal(Scalar *normal) {
+  Scalar norm = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                     normal[2] * normal[2]);
+  Scalar aux = 1.0 / norm;
+  for (int l = 0; l < 3; l++) {
+    normal[l] = aux * normal[l];
   }
+}
+
+// Destruction
+void destroy_instance_vertices(InstanceVertices *vertices) {
+  free(vertices->window);
+  free(vertices->camera);
+  free(vertices->normals);
+  free(vertices);
+}
 
-  // Free pointer
+void destroy_render_triangles(RenderTriangles *triangles) {
+  free(triangles->vertices);
+  free(triangles->window);
+  free(triangles->camera);
+  free(triangles->normals);
+  free(triangles->colors);
   free(triangles);
 }
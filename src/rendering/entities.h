@@ -2,25 +2,80 @@
 #define RENDERING_ENTITIES
 #include "../core/scene.h"
 #include "../core/vectors.h"
+#include "scheduler.h"
+#include "stats.h"
 
 typedef struct {
-  double alpha, beta, gamma;
+  Scalar alpha, beta, gamma;
 } BarycentricCoordinates;
 
+/*
+ * Triangles of an instance prepared for rasterization,
+ * as a structure of arrays: corner k of the i-th triangle
+ * is at index 3 * i + k of each array. The whole batch
+ * takes a handful of allocations, and the rasterizer
+ * reads each attribute from contiguous memory.
+ * */
 typedef struct {
-  Vector **world;
-  Vector **camera;
-  Vector **camera_normals;
-  Vector **projection;
-  Vector **window;
-} RenderTriangle;
-
-// Construction
-RenderTriangle *triangles_from_world_object(Object *world_object,
-                                            SpaceConverter *cvt, int width,
-                                            int height);
+  int n_triangles;
+
+  // Vertex of the mesh at each corner
+  uint32_t *vertices;
+
+  // Window (x, y) and camera space coordinates
+  //    of each corner
+  Scalar (*window)[2];
+  Scalar (*camera)[3];
+
+  // Vertex normal in camera space of each corner,
+  //    NULL if normals weren't computed
+  Scalar (*normals)[3];
+
+  // Lit color of each corner (Gouraud shading),
+  //    NULL when shading per pixel
+  Color *colors;
+} RenderTriangles;
+
+/*
+ * Vertices of an instance transformed for a frame, once
+ * for every triangle drawn from it: vertex v of the mesh
+ * in window (x, y) and camera space coordinates, and its
+ * normal in camera space (NULL if not computed).
+ * */
+typedef struct {
+  Instance *instance;
+  Scalar (*window)[2];
+  Scalar (*camera)[3];
+  Scalar (*normals)[3];
+} InstanceVertices;
+
+/*
+ * Transform every vertex of an instance. If normals is
+ * false, the vertex normals aren't computed (e.g., for
+ * unshaded render modes). Otherwise, the normal of a
+ * vertex averages the normals of every valid triangle of
+ * the mesh using it, so it doesn't depend on which ones
+ * are drawn. Work is split in parallel by the scheduler,
+ * if any.
+ * */
+InstanceVertices *transform_instance(Instance *instance, SpaceConverter *cvt,
+                                     int width, int height, bool normals,
+                                     TaskScheduler *scheduler,
+                                     FrameStats *stats);
+
+/*
+ * Obtain the RenderTriangles of the n_triangles triangles
+ * of the mesh listed by subset (the i-th triangle is the
+ * triangle subset[i]), or of every one if subset is NULL
+ * (n_triangles is then ignored), copying the transformed
+ * vertices to their corners.
+ * */
+RenderTriangles *gather_triangles(InstanceVertices *vertices, int *subset,
+                                  int n_triangles, TaskScheduler *scheduler,
+                                  FrameStats *stats);
 
 // Destruction
-void destroy_render_triangles(RenderTriangle *triangles, int n_triangles);
+void destroy_instance_vertices(InstanceVertices *vertices);
+void destroy_render_triangles(RenderTriangles *triangles);
 
 #endif
@@ -2,6 +2,17 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+// Lighting on plain arrays of 3 Scalars, which the
+//    functions on Vectors wrap
+Scalar dot_array(Scalar *a, Scalar *b);
+void normalize_array(Scalar *a);
+Color diffuse_from_arrays(LightSource *source, Material *material, Scalar *N,
+                          Scalar *L);
+Color specular_from_arrays(LightSource *source, Material *material,
+                           Scalar *R, Scalar *V);
+double attenuation_from_array(LightSource *source, Scalar *P);
 
 Color white() {
   Color p = {255, 255, 255, 255};
@@ -17,96 +28,315 @@ Color ambient_light(Light *light) {
   return mult_scalar_color(light->ka, light->ambient);
 }
 
-Color diffuse_light(Light *light, Vector *N, Vector *L) {
-  double scalar = dot_product(N, L);
-  Vector *aux = scalar_mult_vector(scalar, light->kd, NULL);
-  element_wise_prod(aux, light->od, aux);
+Color diffuse_light(LightSource *source, Material *material, Vector *N,
+                    Vector *L) {
+  return diffuse_from_arrays(source, material, N->arr, L->arr);
+}
+
+Color specular_light(LightSource *source, Material *material, Vector *R,
+                     Vector *V) {
+  return specular_from_arrays(source, material, R->arr, V->arr);
+}
+
+double light_attenuation(LightSource *source, Vector *P) {
+  return attenuation_from_array(source, P->arr);
+}
+
+Color color_from_point(Vector *P, Vector *N, Light *light, Material *material,
+                       int *sources, int n_sources) {
+  return color_from_arrays(P->arr, N->arr, light, material, sources,
+                           n_sources);
+}
+
+Color diffuse_from_arrays(LightSource *source, Material *material, Scalar *N,
+                          Scalar *L) {
+  double scalar = dot_array(N, L);
+  Scalar aux[3];
+  for (int i = 0; i < 3; i++) {
+    aux[i] = (Scalar)scalar * material->kd->arr[i];
+    aux[i] = aux[i] * material->od->arr[i];
+  }
 
   // Create new color
-  Color color = {(int)(*aux->x * light->local.r),
-                 (int)(*aux->y * light->local.g),
-                 (int)(*aux->z * light->local.b), 255};
+  Color color = {(int)(aux[0] * source->local.r),
+                 (int)(aux[1] * source->local.g),
+                 (int)(aux[2] * source->local.b), 255};
 
   // Clip results to [0, 255]
   color.r = (color.r > 255) ? 255 : ((color.r) < 0 ? 0 : color.r);
   color.g = (color.g > 255) ? 255 : ((color.g) < 0 ? 0 : color.g);
   color.b = (color.b > 255) ? 255 : ((color.b) < 0 ? 0 : color.b);
 
-  // Cleanup
-  destroy_vector(aux);
-
   return color;
 }
 
-Color specular_light(Light *light, Vector *R, Vector *V) {
-  double scalar = dot_product(R, V);
-  scalar = pow(scalar, light->eta);
-  scalar *= light->ks;
-  return mult_scalar_color(scalar, light->local);
+Color specular_from_arrays(LightSource *source, Material *material,
+                           Scalar *R, Scalar *V) {
+  double scalar = dot_array(R, V);
+  scalar = pow(scalar, material->eta);
+  scalar *= material->ks;
+  return mult_scalar_color(scalar, source->local);
 }
 
-Color color_from_point(Vector *P, Vector *N, Light *light) {
-  double aux = 0.0;
-  Vector *R = NULL;
-  Vector *L = NULL;
-  Vector *V = NULL;
-  Color ambient = {0, 0, 0, 255};
-  Color diffuse = {0, 0, 0, 255};
-  Color specular = {0, 0, 0, 255};
-  bool discard_diffuse = false;
-  bool discard_specular = false;
+double attenuation_from_array(LightSource *source, Scalar *P) {
+  if (source->type == DIRECTIONAL_LIGHT || source->radius <= 0.0) {
+    return 1.0;
+  }
+
+  // (1 - (d / r)^4)^2, clipped to [0, 1]
+  Scalar aux[3];
+  for (int i = 0; i < 3; i++) {
+    aux[i] = source->pl->arr[i] - P[i];
+  }
+  double ratio = dot_array(aux, aux) / (source->radius * source->radius);
+  double window = 1.0 - ratio * ratio;
+  window = (window < 0.0) ? 0.0 : window;
 
-  // Make a copy of N
-  N = copy_vector(N, NULL);
+  return window * window;
+}
 
+Color color_from_arrays(Scalar *P, Scalar *N, Light *light,
+                        Material *material, int *sources, int n_sources) {
   // Calculate normalized V
-  V = scalar_mult_vector(-1.0, P, NULL);
-  aux = 1.0 / l2_norm(V);
-  scalar_mult_vector(aux, V, V);
+  Scalar V[3] = {-P[0], -P[1], -P[2]};
+  normalize_array(V);
+
+  // Obtain the normal facing the viewer, while
+  //    reflections use the original normal N
+  Scalar facing[3] = {N[0], N[1], N[2]};
+  if (dot_array(V, N) <= 0.001) {
+    for (int i = 0; i < 3; i++) {
+      facing[i] = -facing[i];
+    }
+  }
+
+  // Get colors
+  Color color = ambient_light(light);
+
+  for (int k = 0; k < n_sources; k++) {
+    LightSource *source = light->sources + sources[k];
+    Color diffuse = {0, 0, 0, 255};
+    Color specular = {0, 0, 0, 255};
+    bool discard_diffuse = false;
+    bool discard_specular = false;
+    double attenuation = attenuation_from_array(source, P);
+
+    if (attenuation <= 0.0) {
+      // Out of this source's influence
+      continue;
+    }
+
+    // Calculate normalized L
+    Scalar L[3];
+    for (int i = 0; i < 3; i++) {
+      L[i] = (source->type == DIRECTIONAL_LIGHT) ? -source->pl->arr[i]
+                                                  : source->pl->arr[i] - P[i];
+    }
+    normalize_array(L);
 
-  // Calculate normalized L
-  L = sub_vector(light->pl, P, NULL);
-  aux = 1.0 / l2_norm(L);
-  scalar_mult_vector(aux, L, L);
+    // Calculate normalized R
+    Scalar aux = 2.0 * dot_array(N, L);
+    Scalar R[3];
+    for (int i = 0; i < 3; i++) {
+      R[i] = aux * N[i] - L[i];
+    }
+    normalize_array(R);
 
-  // Calculate normalized R
-  aux = 2.0 * dot_product(N, L);
-  R = scalar_mult_vector(aux, N, NULL);
-  sub_vector(R, L, R);
-  aux = 1.0 / l2_norm(R);
-  scalar_mult_vector(aux, R, R);
+    // Checks if should discard any component
+    if (dot_array(facing, L) <= 0.001) {
+      discard_specular = true;
+      discard_diffuse = true;
+    }
 
-  // Checks if should discard any component
-  if (dot_product(V, N) <= 0.001) {
-    scalar_mult_vector(-1.0, N, N);
+    if (dot_array(V, R) < 0) {
+      discard_specular = true;
+    }
+
+    if (!discard_diffuse) {
+      diffuse = diffuse_from_arrays(source, material, facing, L);
+    }
+
+    if (!discard_specular) {
+      specular = specular_from_arrays(source, material, R, V);
+    }
+
+    if (attenuation < 1.0) {
+      diffuse = mult_scalar_color(attenuation, diffuse);
+      specular = mult_scalar_color(attenuation, specular);
+    }
+
+    // I = (Ia + Id) + Is
+    color = add_color(add_color(color, diffuse), specular);
   }
 
-  if (dot_product(N, L) <= 0.001) {
-    discard_specular = true;
-    discard_diffuse = true;
+  return color;
+}
+
+Scalar dot_array(Scalar *a, Scalar *b) {
+  // Same order as dot_product
+  Scalar sum = 0.0;
+  for (int i = 0; i < 3; i++) {
+    sum += a[i] * b[i];
   }
 
-  if (dot_product(V, R) < 0) {
-    discard_specular = true;
+  return sum;
+}
+
+void normalize_array(Scalar *a) {
+  Scalar norm = sqrt(dot_array(a, a));
+  Scalar aux = 1.0 / norm;
+  for (int i = 0; i < 3; i++) {
+    a[i] = aux * a[i];
   }
+}
 
-  // Get colors
-  ambient = ambient_light(light);
+void light_window_bounds(LightSource *source, Camera *camera, int width,
+                         int height, int *bounds) {
+  // bounds = {x0, y0, x1, y1}, inclusive
+  bounds[0] = 0;
+  bounds[1] = 0;
+  bounds[2] = width - 1;
+  bounds[3] = height - 1;
 
-  if (!discard_diffuse) {
-    diffuse = diffuse_light(light, N, L);
+  if (source->type == DIRECTIONAL_LIGHT || source->radius <= 0.0) {
+    // Unbounded sources affect the whole window
+    return;
   }
 
-  if (!discard_specular) {
-    specular = specular_light(light, R, V);
+  double r = source->radius;
+  double cx = *source->pl->x;
+  double cy = *source->pl->y;
+  double cz = *source->pl->z;
+
+  if (cz + r <= 0.0) {
+    // The sphere of influence is behind the camera
+    bounds[2] = -1;
+    bounds[3] = -1;
+    return;
+  }
+
+  if (cz - r <= 0.001) {
+    // The sphere crosses the camera plane, so its
+    //    projection is unbounded
+    return;
+  }
+
+  // Since z > 0 inside the bounding box of the sphere,
+  //    x / z and y / z attain their extremes at its corners
+  double min_x = INFINITY, max_x = -INFINITY;
+  double min_y = INFINITY, max_y = -INFINITY;
+  for (int i = 0; i < 4; i++) {
+    double z = cz + ((i & 1) ? r : -r);
+    double x = (cx + ((i & 2) ? r : -r)) / z;
+    double y = (cy + ((i & 2) ? r : -r)) / z;
+    min_x = fmin(min_x, x);
+    max_x = fmax(max_x, x);
+    min_y = fmin(min_y, y);
+    max_y = fmax(max_y, y);
+  }
+
+  // Projection to window, see cvt_projection_to_window
+  min_x = camera->d * min_x / camera->hx;
+  max_x = camera->d * max_x / camera->hx;
+  min_y = camera->d * min_y / camera->hy;
+  max_y = camera->d * max_y / camera->hy;
+
+  // Shading points are interpolated from window
+  //    coordinates snapped to the subpixel grid of
+  //    the rasterizer, hence the margin
+  int margin = 2;
+  bounds[0] = (int)floor(width * (min_x + 1) / 2) - margin;
+  bounds[2] = (int)ceil(width * (max_x + 1) / 2) + margin;
+  bounds[1] = (int)floor(height - height * (max_y + 1) / 2) - margin;
+  bounds[3] = (int)ceil(height - height * (min_y + 1) / 2) + margin;
+}
+
+LightTiles *cull_light_sources(Light *light, Camera *camera, int width,
+                               int height, int tile_size) {
+  LightTiles *tiles = (LightTiles *)malloc(sizeof(LightTiles));
+  tiles->tile_size = tile_size;
+  tiles->tiles_x = (width + tile_size - 1) / tile_size;
+  tiles->tiles_y = (height + tile_size - 1) / tile_size;
+  int n_tiles = tiles->tiles_x * tiles->tiles_y;
+  int *ranges = (int *)malloc(4 * light->n_sources * sizeof(int));
+  tiles->offsets = (int *)calloc(n_tiles + 1, sizeof(int));
+
+  // Obtain the range of tiles of each source and
+  //    count how many sources each tile has
+  for (int k = 0; k < light->n_sources; k++) {
+    int *range = ranges + 4 * k;
+    light_window_bounds(light->sources + k, camera, width, height, range);
+    range[0] = (range[0] < 0) ? 0 : range[0] / tile_size;
+    range[1] = (range[1] < 0) ? 0 : range[1] / tile_size;
+    range[2] = (range[2] < 0) ? -1 : range[2] / tile_size;
+    range[3] = (range[3] < 0) ? -1 : range[3] / tile_size;
+    range[2] = (range[2] >= tiles->tiles_x) ? tiles->tiles_x - 1 : range[2];
+    range[3] = (range[3] >= tiles->tiles_y) ? tiles->tiles_y - 1 : range[3];
+
+    for (int ty = range[1]; ty <= range[3]; ty++) {
+      for (int tx = range[0]; tx <= range[2]; tx++) {
+        tiles->offsets[ty * tiles->tiles_x + tx + 1]++;
+      }
+    }
+  }
+
+  // Prefix sum of counts
+  for (int t = 0; t < n_tiles; t++) {
+    tiles->offsets[t + 1] += tiles->offsets[t];
+  }
+
+  // Fill tile lists, preserving the source order
+  int *cursor = (int *)malloc(n_tiles * sizeof(int));
+  for (int t = 0; t < n_tiles; t++) {
+    cursor[t] = tiles->offsets[t];
+  }
+  tiles->indices = (int *)malloc((tiles->offsets[n_tiles] + 1) * sizeof(int));
+  for (int k = 0; k < light->n_sources; k++) {
+    int *range = ranges + 4 * k;
+    for (int ty = range[1]; ty <= range[3]; ty++) {
+      for (int tx = range[0]; tx <= range[2]; tx++) {
+        tiles->indices[cursor[ty * tiles->tiles_x + tx]++] = k;
+      }
+    }
   }
 
   // Cleanup
-  destroy_vector(R);
-  destroy_vector(N);
-  destroy_vector(L);
-  destroy_vector(V);
+  free(cursor);
+  free(ranges);
+
+  return tiles;
+}
+
+int *light_sources_at(LightTiles *tiles, int x, int y, int *n_sources) {
+  int t = (y / tiles->tile_size) * tiles->tiles_x + x / tiles->tile_size;
+  *n_sources = tiles->offsets[t + 1] - tiles->offsets[t];
+  return tiles->indices + tiles->offsets[t];
+}
+
+int light_sources_reaching(Light *light, Scalar *P, int *sources) {
+  int n_sources = 0;
+  for (int k = 0; k < light->n_sources; k++) {
+    LightSource *source = light->sources + k;
+    if (source->type != DIRECTIONAL_LIGHT && source->radius > 0.0) {
+      // Same ratio as attenuation_from_array, which
+      //    is zero from the radius on
+      Scalar aux[3];
+      for (int i = 0; i < 3; i++) {
+        aux[i] = source->pl->arr[i] - P[i];
+      }
+      double ratio = dot_array(aux, aux) / (source->radius * source->radius);
+      if (ratio >= 1.0) {
+        continue;
+      }
+    }
+    sources[n_sources++] = k;
+  }
+
+  return n_sources;
+}
 
-  // I = (Ia + Id) + Is
-  return add_color(add_color(ambient, diffuse), specular);
+void destroy_light_tiles(LightTiles *tiles) {
+  free(tiles->offsets);
+  free(tiles->indices);
+  free(tiles);
 }
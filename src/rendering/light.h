@@ -2,16 +2,67 @@
 #define RENDERING_LIGHT
 #include "../core/scene.h"
 
+typedef struct {
+  int tile_size, tiles_x, tiles_y;
+
+  // Light sources that might affect the tile t
+  //    are indices[offsets[t]:offsets[t + 1]]
+  int *offsets;
+  int *indices;
+} LightTiles;
+
 Color white();
 Color black();
 Color ambient_light(Light *light);
-Color diffuse_light(Light *light, Vector *N, Vector *L);
-Color specular_light(Light *light, Vector *R, Vector *V);
+Color diffuse_light(LightSource *source, Material *material, Vector *N,
+                    Vector *L);
+Color specular_light(LightSource *source, Material *material, Vector *R,
+                     Vector *V);
+
+/*
+ * Obtain the attenuation of a light source at the point
+ * P in camera space. Sources with bounded influence fade
+ * smoothly to zero at their radius.
+ * */
+double light_attenuation(LightSource *source, Vector *P);
 
 /*
  * Obtain the color for a given point P in camera space,
- * given its normal N and the scene light parameters.
+ * given its normal N, the surface material and the scene
+ * light sources listed in sources.
+ * */
+Color color_from_point(Vector *P, Vector *N, Light *light, Material *material,
+                       int *sources, int n_sources);
+
+/*
+ * Same as color_from_point, with P and N given as plain
+ * arrays of 3 Scalars, so that shading a pixel doesn't
+ * allocate any vector.
+ * */
+Color color_from_arrays(Scalar *P, Scalar *N, Light *light,
+                        Material *material, int *sources, int n_sources);
+
+/*
+ * Assign every light source to the screen tiles its
+ * influence might reach, so that each pixel only evaluates
+ * the sources that can affect it.
+ * */
+LightTiles *cull_light_sources(Light *light, Camera *camera, int width,
+                               int height, int tile_size);
+
+/*
+ * Obtain the light sources that might affect the
+ * pixel (x, y) of the window.
  * */
-Color color_from_point(Vector *P, Vector *N, Light *light);
+int *light_sources_at(LightTiles *tiles, int x, int y, int *n_sources);
+
+/*
+ * Write to sources the light sources whose influence
+ * reaches the point P in camera space, returning how many
+ * there are. Sources without a radius always reach it.
+ * */
+int light_sources_reaching(Light *light, Scalar *P, int *sources);
+
+void destroy_light_tiles(LightTiles *tiles);
 
 #endif
@@ -5,43 +5,51 @@
 
 /*
  * Interpolate a point P (given in barycentric coordinates
- * of the parent Triangle's window coordinates) to camera
- * space.
+ * of the window coordinates of the t-th triangle of T) to
+ * camera space.
  * */
 Vector *interpolate_to_camera_space(BarycentricCoordinates *P,
-                                    RenderTriangle *parent);
+                                    RenderTriangles *T, int t);
 
 /*
  * Interpolate the normal in camera space of a point P (given
- * in barycentric coordinates of the parent Triangle's window
- * coordinates).
+ * in barycentric coordinates of the window coordinates of the
+ * t-th triangle of T).
  * */
-Vector *interpolate_normal(BarycentricCoordinates *P, RenderTriangle *parent);
+Vector *interpolate_normal(BarycentricCoordinates *P, RenderTriangles *T,
+                           int t);
 
 /*
- * Obtain the slope of the line that intersects
- * both points A and B. Vectors must be 2D.
+ * Same as the interpolations above, writing the result
+ * into dst (an array of 3 Scalars) instead of allocating
+ * a vector.
  * */
-double get_slope(Vector *A, Vector *B);
+void interpolate_to_camera_space_into(BarycentricCoordinates *P,
+                                      RenderTriangles *T, int t, Scalar *dst);
+void interpolate_normal_into(BarycentricCoordinates *P, RenderTriangles *T,
+                             int t, Scalar *dst);
 
 /*
- * Obtain the barycentric coordinates of a point P defined
- * in the window space of the parent Triangle.
+ * Interpolate the vertex colors of the t-th triangle of T
+ * (Gouraud shading) at a point P given in barycentric
+ * coordinates of its window coordinates.
  * */
-BarycentricCoordinates get_bcoordinates_from_window(Vector *P,
-                                                    RenderTriangle *parent);
+Color interpolate_color(BarycentricCoordinates *P, RenderTriangles *T,
+                        int t);
 
 /*
- * Sort vertices of a triangle according to the
- * y component of the window space.
+ * Obtain the slope of the line that intersects
+ * both points A and B. Vectors must be 2D.
  * */
-void sort_vertices_by_window_y(RenderTriangle *T);
+Scalar get_slope(Vector *A, Vector *B);
 
 /*
- * Sort vertices of a triangle according to the
- * y component of the window space.
+ * Obtain the barycentric coordinates of a point P defined
+ * in the window space of the t-th triangle of T.
  * */
-void sort_vertices_by_window_horizontal_line(RenderTriangle *T, bool v1_v2);
+BarycentricCoordinates get_bcoordinates_from_window(Vector *P,
+                                                    RenderTriangles *T,
+                                                    int t);
 
 /*
  * Check whether two points A and B define
@@ -50,9 +58,15 @@ void sort_vertices_by_window_horizontal_line(RenderTriangle *T, bool v1_v2);
 bool is_horizontal(Vector *A, Vector *B);
 
 /*
- * Check whether three 2D points define a
+ * Check whether three 2D points (x, y) define a
  * triangle.
  * */
-bool is_valid_triangle(Vector *A, Vector *B, Vector *C);
+bool is_valid_triangle(Scalar *A, Scalar *B, Scalar *C);
+
+/*
+ * Check whether the t-th triangle of T lies entirely
+ * outside a window of the given size.
+ * */
+bool is_outside_window(RenderTriangles *T, int t, int width, int height);
 
 #endif
@@ -0,0 +1,359 @@
+#include "occlusion.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bits per axis of the Morton codes
+#define MORTON_BITS 10
+
+// Relative margin of the nearest depth of a cluster,
+//    which covers rounding in the geometry stages
+#define DEPTH_MARGIN 1e-4
+
+struct OcclusionCulling {
+  // Allocated one by one, so that the clusters of an
+  //    instance stay put when more instances are added
+  InstanceClusters **instances;
+  int n_instances;
+};
+
+typedef struct {
+  uint32_t code;
+  int index;
+} MortonKey;
+
+// Clusters
+void build_clusters(InstanceClusters *clusters, Object *mesh);
+void clear_clusters(InstanceClusters *clusters);
+uint32_t morton_code(double x, double y, double z);
+int compare_morton_keys(const void *a, const void *b);
+
+OcclusionCulling *create_occlusion_culling() {
+  OcclusionCulling *occlusion =
+      (OcclusionCulling *)calloc(1, sizeof(OcclusionCulling));
+  assert(occlusion != NULL);
+  return occlusion;
+}
+
+void reset_occlusion_culling(OcclusionCulling *occlusion) {
+  for (int i = 0; i < occlusion->n_instances; i++) {
+    clear_clusters(occlusion->instances[i]);
+    free(occlusion->instances[i]);
+  }
+  free(occlusion->instances);
+  occlusion->instances = NULL;
+  occlusion->n_instances = 0;
+}
+
+void destroy_occlusion_culling(OcclusionCulling *occlusion) {
+  reset_occlusion_culling(occlusion);
+  free(occlusion);
+}
+
+InstanceClusters *instance_clusters(OcclusionCulling *occlusion, int i,
+                                    Instance *instance) {
+  if (i >= occlusion->n_instances) {
+    occlusion->instances = (InstanceClusters **)realloc(
+        occlusion->instances, (i + 1) * sizeof(InstanceClusters *));
+    assert(occlusion->instances != NULL);
+    for (int k = occlusion->n_instances; k <= i; k++) {
+      occlusion->instances[k] =
+          (InstanceClusters *)calloc(1, sizeof(InstanceClusters));
+      assert(occlusion->instances[k] != NULL);
+    }
+    occlusion->n_instances = i + 1;
+  }
+
+  InstanceClusters *clusters = occlusion->instances[i];
+  Object *mesh = instance->mesh;
+  if (clusters->mesh != mesh || clusters->n_triangles != mesh->n_triangles) {
+    clear_clusters(clusters);
+    build_clusters(clusters, mesh);
+  }
+
+  return clusters;
+}
+
+uint32_t morton_code(double x, double y, double z) {
+  // Interleave the bits of the quantized coordinates,
+  //    which are given in [0, 1]
+  double scale = (1 << MORTON_BITS) - 1;
+  uint32_t q[3] = {(uint32_t)(x * scale), (uint32_t)(y * scale),
+                   (uint32_t)(z * scale)};
+  uint32_t code = 0;
+  for (int b = 0; b < MORTON_BITS; b++) {
+    for (int k = 0; k < 3; k++) {
+      code |= ((q[k] >> b) & 1u) << (3 * b + k);
+    }
+  }
+
+  return code;
+}
+
+int compare_morton_keys(const void *a, const void *b) {
+  const MortonKey *ka = (const MortonKey *)a, *kb = (const MortonKey *)b;
+  if (ka->code != kb->code) {
+    return (ka->code < kb->code) ? -1 : 1;
+  }
+
+  return ka->index - kb->index;
+}
+
+void build_clusters(InstanceClusters *clusters, Object *mesh) {
+  int n = mesh->n_triangles;
+  clusters->mesh = mesh;
+  clusters->n_triangles = n;
+  clusters->n_clusters = (n + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+  clusters->order = (int *)malloc(n * sizeof(int));
+  clusters->clusters =
+      (Cluster *)malloc(clusters->n_clusters * sizeof(Cluster));
+  clusters->visible = (bool *)calloc(clusters->n_clusters, sizeof(bool));
+  assert(clusters->order != NULL && clusters->clusters != NULL &&
+         clusters->visible != NULL);
+
+  // Bounds of the mesh, used to quantize the centroids
+  double min[3] = {INFINITY, INFINITY, INFINITY};
+  double max[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (int v = 0; v < mesh->n_vertices; v++) {
+    for (int k = 0; k < 3; k++) {
+      min[k] = fmin(min[k], mesh->positions[3 * v + k]);
+      max[k] = fmax(max[k], mesh->positions[3 * v + k]);
+    }
+  }
+
+  // Sort the triangles by the Morton code of their
+  //    centroids, so that consecutive triangles are
+  //    close to each other
+  MortonKey *keys = (MortonKey *)malloc(n * sizeof(MortonKey));
+  assert(keys != NULL);
+  for (int i = 0; i < n; i++) {
+    double c[3] = {0.0, 0.0, 0.0};
+    for (int v = 0; v < 3; v++) {
+      float *p = mesh->positions + 3 * mesh->indices[3 * i + v];
+      for (int k = 0; k < 3; k++) {
+        c[k] += p[k] / 3.0;
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      double extent = max[k] - min[k];
+      c[k] = (extent > 0.0) ? fmin(fmax((c[k] - min[k]) / extent, 0.0), 1.0)
+                            : 0.0;
+    }
+    keys[i].code = morton_code(c[0], c[1], c[2]);
+    keys[i].index = i;
+  }
+  qsort(keys, n, sizeof(MortonKey), compare_morton_keys);
+
+  for (int i = 0; i < n; i++) {
+    clusters->order[i] = keys[i].index;
+  }
+  free(keys);
+
+  // Bounding box of each cluster
+  for (int c = 0; c < clusters->n_clusters; c++) {
+    Cluster *cluster = clusters->clusters + c;
+    cluster->first = c * CLUSTER_SIZE;
+    cluster->count = (n - cluster->first < CLUSTER_SIZE) ? n - cluster->first
+                                                         : CLUSTER_SIZE;
+    for (int k = 0; k < 3; k++) {
+      cluster->min[k] = INFINITY;
+      cluster->max[k] = -INFINITY;
+    }
+
+    for (int i = cluster->first; i < cluster->first + cluster->count; i++) {
+      int t = clusters->order[i];
+      for (int v = 0; v < 3; v++) {
+        float *p = mesh->positions + 3 * mesh->indices[3 * t + v];
+        for (int k = 0; k < 3; k++) {
+          cluster->min[k] = fminf(cluster->min[k], p[k]);
+          cluster->max[k] = fmaxf(cluster->max[k], p[k]);
+        }
+      }
+    }
+  }
+}
+
+void clear_clusters(InstanceClusters *clusters) {
+  free(clusters->order);
+  free(clusters->clusters);
+  free(clusters->visible);
+  memset(clusters, 0, sizeof(InstanceClusters));
+}
+
+bool project_cluster(Cluster *cluster, Instance *instance, SpaceConverter *cvt,
+                     int width, int height, BoundingBox *box, double *min_z) {
+  Camera *camera = cvt->camera;
+  double min_x = INFINITY, max_x = -INFINITY;
+  double min_y = INFINITY, max_y = -INFINITY;
+  *min_z = INFINITY;
+
+  // The projection of the box is within the projection
+  //    of its corners, as long as they're all in front
+  //    of the camera
+  for (int corner = 0; corner < 8; corner++) {
+    double p[3], world[3], offset[3], c[3];
+    for (int k = 0; k < 3; k++) {
+      p[k] = (corner & (1 << k)) ? cluster->max[k] : cluster->min[k];
+    }
+
+    // Same conversions of the geometry stages
+    for (int r = 0; r < 3; r++) {
+      world[r] = instance->translation->arr[r];
+      for (int k = 0; k < 3; k++) {
+        world[r] += instance->model->arr[r][k] * p[k];
+      }
+      offset[r] = world[r] - camera->C->arr[r];
+    }
+    for (int r = 0; r < 3; r++) {
+      c[r] = 0.0;
+      for (int k = 0; k < 3; k++) {
+        c[r] += cvt->world_to_camera->arr[r][k] * offset[k];
+      }
+    }
+
+    if (c[2] <= 0.0) {
+      // Crosses (or is behind) the camera plane
+      box->min_x = box->min_y = 0;
+      box->max_x = width - 1;
+      box->max_y = height - 1;
+      *min_z = -INFINITY;
+      return true;
+    }
+
+    double x = width * (camera->d * c[0] / c[2] / camera->hx + 1) / 2;
+    double y = height - height * (camera->d * c[1] / c[2] / camera->hy + 1) / 2;
+    min_x = fmin(min_x, x);
+    max_x = fmax(max_x, x);
+    min_y = fmin(min_y, y);
+    max_y = fmax(max_y, y);
+    *min_z = fmin(*min_z, c[2]);
+  }
+
+  // One pixel of margin covers the snapping of
+  //    the window coordinates
+  box->min_x = (int)fmax(0.0, floor(min_x) - 1);
+  box->min_y = (int)fmax(0.0, floor(min_y) - 1);
+  box->max_x = (int)fmin(width - 1, floor(max_x) + 1);
+  box->max_y = (int)fmin(height - 1, floor(max_y) + 1);
+  *min_z -= DEPTH_MARGIN * *min_z;
+  return box->min_x <= box->max_x && box->min_y <= box->max_y;
+}
+
+DepthPyramid *create_depth_pyramid(int width, int height) {
+  DepthPyramid *pyramid = (DepthPyramid *)malloc(sizeof(DepthPyramid));
+  assert(pyramid != NULL);
+
+  // Halve each level until a single texel is left
+  int w = (width + PYRAMID_BLOCK - 1) / PYRAMID_BLOCK;
+  int h = (height + PYRAMID_BLOCK - 1) / PYRAMID_BLOCK;
+  int levels = 1;
+  for (int lw = w, lh = h; lw > 1 || lh > 1; levels++) {
+    lw = (lw + 1) / 2;
+    lh = (lh + 1) / 2;
+  }
+
+  pyramid->levels = levels;
+  pyramid->widths = (int *)malloc(levels * sizeof(int));
+  pyramid->heights = (int *)malloc(levels * sizeof(int));
+  pyramid->depth = (float **)malloc(levels * sizeof(float *));
+  assert(pyramid->widths != NULL && pyramid->heights != NULL &&
+         pyramid->depth != NULL);
+  for (int l = 0; l < levels; l++) {
+    pyramid->widths[l] = w;
+    pyramid->heights[l] = h;
+    pyramid->depth[l] = (float *)malloc((size_t)w * h * sizeof(float));
+    assert(pyramid->depth[l] != NULL);
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+  }
+
+  return pyramid;
+}
+
+void store_tile_depth(DepthPyramid *pyramid, int x0, int y0, int x1, int y1,
+                      Scalar *depth, int stride, int samples) {
+  assert(x0 % PYRAMID_BLOCK == 0 && y0 % PYRAMID_BLOCK == 0);
+  float *level = pyramid->depth[0];
+  int w = pyramid->widths[0];
+
+  for (int by = y0; by < y1; by += PYRAMID_BLOCK) {
+    for (int bx = x0; bx < x1; bx += PYRAMID_BLOCK) {
+      // Farthest sample of the block (only the
+      //    pixels within the window)
+      float farthest = (depth == NULL) ? INFINITY : -INFINITY;
+      int ey = (by + PYRAMID_BLOCK < y1) ? by + PYRAMID_BLOCK : y1;
+      int ex = (bx + PYRAMID_BLOCK < x1) ? bx + PYRAMID_BLOCK : x1;
+      for (int i = by; i < ey && depth != NULL; i++) {
+        Scalar *row = depth + ((size_t)(i - y0) * stride + (bx - x0)) * samples;
+        for (int k = 0; k < (ex - bx) * samples; k++) {
+          farthest = fmaxf(farthest, (float)row[k]);
+        }
+      }
+      level[(by / PYRAMID_BLOCK) * w + bx / PYRAMID_BLOCK] = farthest;
+    }
+  }
+}
+
+void build_depth_pyramid(DepthPyramid *pyramid) {
+  for (int l = 1; l < pyramid->levels; l++) {
+    float *src = pyramid->depth[l - 1], *dst = pyramid->depth[l];
+    int sw = pyramid->widths[l - 1], sh = pyramid->heights[l - 1];
+    int w = pyramid->widths[l], h = pyramid->heights[l];
+
+    // Each texel covers (up to) 2x2 texels
+    //    of the previous level
+    for (int i = 0; i < h; i++) {
+      for (int j = 0; j < w; j++) {
+        float farthest = -INFINITY;
+        for (int di = 0; di < 2 && 2 * i + di < sh; di++) {
+          for (int dj = 0; dj < 2 && 2 * j + dj < sw; dj++) {
+            farthest = fmaxf(farthest, src[(2 * i + di) * sw + 2 * j + dj]);
+          }
+        }
+        dst[i * w + j] = farthest;
+      }
+    }
+  }
+}
+
+bool is_occluded(DepthPyramid *pyramid, BoundingBox *box, double min_z) {
+  // Texels of the finest level covered by the box,
+  //    then the level where they span a few texels
+  int x0 = box->min_x / PYRAMID_BLOCK, x1 = box->max_x / PYRAMID_BLOCK;
+  int y0 = box->min_y / PYRAMID_BLOCK, y1 = box->max_y / PYRAMID_BLOCK;
+  int l = 0;
+  while (l + 1 < pyramid->levels && (x1 - x0 > 2 || y1 - y0 > 2)) {
+    x0 /= 2;
+    x1 /= 2;
+    y0 /= 2;
+    y1 /= 2;
+    l++;
+  }
+
+  float *level = pyramid->depth[l];
+  int w = pyramid->widths[l];
+  for (int i = y0; i <= y1; i++) {
+    for (int j = x0; j <= x1; j++) {
+      // Strictly farther than the texel, so that
+      //    clusters whose depth is the texel's own
+      //    (e.g., the visible ones) aren't occluded
+      if (!(min_z > level[i * w + j])) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void destroy_depth_pyramid(DepthPyramid *pyramid) {
+  for (int l = 0; l < pyramid->levels; l++) {
+    free(pyramid->depth[l]);
+  }
+  free(pyramid->depth);
+  free(pyramid->widths);
+  free(pyramid->heights);
+  free(pyramid);
+}
@@ -0,0 +1,112 @@
+#ifndef RENDERING_OCCLUSION
+#define RENDERING_OCCLUSION
+#include "../core/scene.h"
+#include "binning.h"
+#include <stdbool.h>
+
+// Maximum number of triangles of a cluster
+#define CLUSTER_SIZE 128
+
+// Size (in pixels) of the texels of the finest
+//    level of the depth pyramid
+#define PYRAMID_BLOCK 8
+
+/*
+ * State of the cluster occlusion culling, kept by the
+ * caller across frames. Meshes are split into clusters
+ * of spatially close triangles, built the first time
+ * each instance is drawn, and the clusters drawn in the
+ * last frame are remembered, so that they're drawn first
+ * and occlude the remaining ones. Clusters depend on the
+ * meshes, so the state must be reset whenever the scene
+ * changes.
+ * */
+typedef struct OcclusionCulling OcclusionCulling;
+
+typedef struct {
+  // Triangles of the cluster are the mesh triangles
+  //    order[first:first + count]
+  int first, count;
+
+  // Bounding box, in object space
+  float min[3], max[3];
+} Cluster;
+
+typedef struct {
+  Object *mesh;
+  int n_triangles;
+
+  // Triangles of the mesh sorted along a space
+  //    filling curve, which are then split in
+  //    consecutive clusters
+  int *order;
+  Cluster *clusters;
+  int n_clusters;
+
+  // Whether each cluster was drawn in the last frame
+  bool *visible;
+} InstanceClusters;
+
+/*
+ * Coarse depth buffer, where each texel holds the
+ * farthest depth of a block of pixels. The finest level
+ * has one texel per PYRAMID_BLOCK x PYRAMID_BLOCK pixels
+ * and each level halves the previous one.
+ * */
+typedef struct {
+  int levels;
+  int *widths, *heights;
+  float **depth;
+} DepthPyramid;
+
+OcclusionCulling *create_occlusion_culling();
+
+// Forget every cluster (e.g., after loading a new scene)
+void reset_occlusion_culling(OcclusionCulling *occlusion);
+
+void destroy_occlusion_culling(OcclusionCulling *occlusion);
+
+/*
+ * Obtain the clusters of the i-th instance of a scene,
+ * building them if the instance's mesh changed.
+ * */
+InstanceClusters *instance_clusters(OcclusionCulling *occlusion, int i,
+                                    Instance *instance);
+
+/*
+ * Obtain the window region that might be covered by a
+ * cluster, with a margin, and its nearest depth. Returns
+ * false if the cluster is outside the window. Clusters
+ * that cross the camera plane cover the whole window
+ * with depth -INFINITY, so that they're never occluded.
+ * */
+bool project_cluster(Cluster *cluster, Instance *instance, SpaceConverter *cvt,
+                     int width, int height, BoundingBox *box, double *min_z);
+
+// Depth pyramid
+DepthPyramid *create_depth_pyramid(int width, int height);
+
+/*
+ * Store the depth of the pixels [x0, x1) x [y0, y1) of a
+ * tile into the finest level, where the depth of sample s
+ * of pixel (i, j) is depth[((i - y0) * stride + (j - x0)) *
+ * samples + s]. The tile must be aligned to PYRAMID_BLOCK,
+ * so that tiles can be stored concurrently. If depth is
+ * NULL, the tile is empty (infinitely far away).
+ * */
+void store_tile_depth(DepthPyramid *pyramid, int x0, int y0, int x1, int y1,
+                      Scalar *depth, int stride, int samples);
+
+// Obtain the coarser levels from the finest one
+void build_depth_pyramid(DepthPyramid *pyramid);
+
+/*
+ * Whether every pixel of box is nearer than min_z, i.e.,
+ * a primitive within box and not nearer than min_z would
+ * fail the depth test everywhere.
+ * */
+bool is_occluded(DepthPyramid *pyramid, BoundingBox *box, double min_z);
+
+void destroy_depth_pyramid(DepthPyramid *pyramid);
+
+#endif
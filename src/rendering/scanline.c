@@ -1,272 +1,1688 @@
 #include "scanline.h"
+#include "../core/meshlets.h"
+#include "binning.h"
 #include "entities.h"
 #include "light.h"
 #include "math_utils.h"
 #include <assert.h>
 #include <math.h>
-#include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-// Z-buffer utilities
-double **create_zbuffer(int width, int height);
-void destroy_zbuffer(double **zbuffer, int width, int height);
+// Size (in pixels) of the screen tiles used
+//    for light culling
+#define LIGHT_TILE_SIZE 16
+
+// Size (in pixels) of the screen tiles used
+//    for binning and rasterization
+#define BIN_TILE_SIZE 64
+
+// Number of consecutive primitives binned
+//    together (i.e., by the same worker)
+#define BIN_CHUNK_SIZE 4096
+
+// Number of triangles rasterized between
+//    polls of the cancellation callback
+#define CANCEL_INTERVAL 64
+
+// Number of shaded pixels between timings of the
+//    shading, whose time is extrapolated to the
+//    others instead of timing every pixel
+#define SHADE_TIMING_INTERVAL 16
+
+// Size (in pixels) of the square drawn for
+//    each vertex in point mode
+#define POINT_SPLAT_SIZE 2
+
+// Bits of subpixel precision of the window coordinates
+//    seen by the rasterizer, i.e., vertices are snapped
+//    to a grid of 1 / SUBPIXEL_SCALE pixels
+#define SUBPIXEL_BITS 8
+#define SUBPIXEL_SCALE (1 << SUBPIXEL_BITS)
+
+// Triangles with a vertex farther than this (in pixels)
+//    from the window are rasterized in floating point,
+//    since their edge functions could overflow 64 bits
+#define GUARD_BAND (1 << 21)
+
+// Sample positions, relative to the pixel's top-left
+//    corner, of each supported sample count (same
+//    patterns as the standard D3D multisample ones).
+//    Every position is a multiple of 1 / 16, so they
+//    lie exactly on the subpixel grid
+static const double SAMPLES_1X[1][2] = {{0.5, 0.5}};
+static const double SAMPLES_2X[2][2] = {{0.75, 0.75}, {0.25, 0.25}};
+static const double SAMPLES_4X[4][2] = {
+    {0.375, 0.125}, {0.875, 0.375}, {0.125, 0.625}, {0.625, 0.875}};
+static const double SAMPLES_8X[8][2] = {
+    {0.5625, 0.3125}, {0.4375, 0.6875}, {0.8125, 0.5625}, {0.3125, 0.1875},
+    {0.1875, 0.8125}, {0.0625, 0.4375}, {0.6875, 0.9375}, {0.9375, 0.0625}};
+
+// State shared by every triangle of a frame
+typedef struct {
+  // Pixels of the frame (NULL if the frame is only
+  //    packed into the target of the options)
+  Color **pixels;
+  int w, h;
+  Light *light;
+  LightTiles *tiles;
+  Material *material;
+  FrameStats *stats;
+
+  // Screen tile being rasterized, [x0, x1) x [y0, y1),
+  //    and its depth and color buffers, where pixel
+  //    (i, j) is at index (i - y0) * BIN_TILE_SIZE +
+  //    (j - x0). Colors are stored in the frame once
+  //    the tile is done
+  int x0, y0, x1, y1;
+  Scalar *depth;
+  Color *colors;
+
+  // Multisampling: sample positions and per-sample
+  //    depth and color of the tile, where sample s of
+  //    pixel (i, j) is at index k * samples + s, with k
+  //    the index of the pixel in the tile
+  int samples;
+  const double (*positions)[2];
+  Scalar *sample_depth;
+  Color *sample_colors;
+
+  // Pixels shaded in the tile, how many of them were
+  //    timed and the time it took to shade those
+  int shaded, timed;
+  double shade_time;
+
+  RenderOptions *options;
+  bool cancelled;
+} RasterContext;
+
+// Edge function of the edge from A to B, i.e., twice
+//    the signed area of the triangle (A, B, P), kept
+//    as dx * (y - y0) - dy * (x - x0)
+typedef struct {
+  double x0, y0, dx, dy;
+} EdgeEquation;
+
+// Edge function a * x + b * y + c over the subpixel
+//    grid (x and y in 1 / SUBPIXEL_SCALE pixels),
+//    which is exact for every snapped triangle. A
+//    sample is inside the edge if e + bias >= 0, where
+//    bias is -1 for the edges that don't own the
+//    samples lying on them (see setup_fixed_edges)
+typedef struct {
+  int64_t a, b, c, bias;
+} FixedEdge;
+
+// Setup of a triangle, obtained once per frame: its
+//    bounding box, visibility and, if it covers pixels,
+//    its edge equations (edge k is the one opposite to
+//    vertex k) and the inverse of its signed area.
+//    Triangles inside the guard band also have fixed
+//    point edge functions, oriented so that the inside
+//    is positive, and twice their (positive) area
+typedef struct {
+  BoundingBox box;
+  bool visible, degenerate, culled;
+  EdgeEquation edges[3];
+  double inv_area;
+  bool fixed;
+  FixedEdge fixed_edges[3];
+  int64_t fixed_area;
+} TriangleSetup;
+
+// Primitive submitted to the bins: a triangle (shaded
+//    and wireframe modes), the t-th one of triangles,
+//    or a vertex (points mode, triangles is NULL)
+typedef struct {
+  RenderTriangles *triangles;
+  int t;
+  TriangleSetup *setup;
+  Material *material;
+  double x, y;
+  Scalar z;
+} Primitive;
+
+// Every primitive of a frame, in submission order
+typedef struct {
+  Primitive *primitives;
+  BoundingBox *boxes;
+  int n, capacity;
+} PrimitiveList;
+
+// Triangles of an instance submitted in a pass, which
+//    live until the end of the frame: the triangles of
+//    the mesh listed by subset (or every one if NULL)
+typedef struct {
+  int *subset;
+  int n_triangles;
+  RenderTriangles *triangles;
+  TriangleSetup *setups;
+} Submission;
+
+// Occlusion culling: window region and nearest depth
+//    of a cluster, whether it's inside the window and
+//    the pass where it was drawn (0 if it wasn't)
+typedef struct {
+  BoundingBox box;
+  double min_z;
+  bool inside;
+  int pass;
+} ClusterView;
+
+// Occlusion culling: depth (per sample) and, with
+//    multisampling, sample colors of a tile drawn by
+//    the first pass, which the second one draws on top
+//    of (both NULL if the tile was empty)
+typedef struct {
+  Scalar *depth;
+  Color *colors;
+} SavedTile;
+
+// Data shared by the tasks of the parallel stages
+typedef struct {
+  RasterContext *ctx;
+  Instance *instance;
+  SpaceConverter *cvt;
+  RenderTriangles *triangles;
+  int *subset;
+  int n_triangles;
+
+  // Setup of each triangle
+  TriangleSetup *setups;
+
+  // Points: candidate point of each vertex
+  Primitive *points;
+  BoundingBox *boxes;
+  bool *visible;
+
+  // Gouraud shading: the first triangle (3 * triangle +
+  //    corner) where each vertex appears and its color
+  int *owners;
+  Color *colors;
+
+  // Raster: bins of the primitives from first on,
+  //    tiles to rasterize (every one if NULL), one
+  //    context and stats per worker, the depth pyramid
+  //    where tiles are stored and the saved tiles of
+  //    each pass (if any)
+  TriangleBins *bins;
+  int first, *tiles;
+  PrimitiveList *list;
+  RasterContext *workers;
+  FrameStats *worker_stats;
+  DepthPyramid *pyramid;
+  SavedTile *saved;
+  int pass;
+} StageJob;
+
+// Submission utilities
+void submit_instance(Instance *instance, SpaceConverter *cvt,
+                     InstanceVertices **vertices, RasterContext *ctx,
+                     PrimitiveList *list, Submission *submission);
+void setup_triangles(void *data, int task, int worker);
+void submit_points(Instance *instance, SpaceConverter *cvt,
+                   RasterContext *ctx, PrimitiveList *list);
+void transform_points(void *data, int task, int worker);
+void append_primitive(PrimitiveList *list, Primitive primitive,
+                      BoundingBox box);
+BoundingBox triangle_box(RenderTriangles *T, int t, int width, int height);
 
 // Rasterization utilities
-void rasterize_from_bottom(RenderTriangle *T, Color **pixels, double **zbuffer,
-                           int w, int h, Light *light);
+RasterContext *create_worker_contexts(RasterContext *ctx, FrameStats *stats,
+                                      int n_workers);
+void destroy_worker_contexts(RasterContext *workers, int n_workers);
+void rasterize_tiles(RasterContext *ctx, StageJob *job, int first_new);
+void rasterize_tile_task(void *data, int task, int worker);
+void rasterize_tile(TriangleBins *bins, int t, Primitive *primitives,
+                    SavedTile *saved, RasterContext *ctx);
+void save_tile(SavedTile *saved, RasterContext *ctx);
+void load_tile(RasterContext *ctx);
+void store_tile(RasterContext *ctx);
+bool setup_fixed_edges(Scalar (*window)[2], TriangleSetup *setup);
+void rasterize_triangle(Primitive *primitive, RasterContext *ctx);
+void rasterize_fixed(Primitive *primitive, RasterContext *ctx);
+void rasterize_float(Primitive *primitive, RasterContext *ctx);
+void shade_samples(Primitive *primitive, int i, int j, unsigned int coverage,
+                   double weights[][3], double *centroid, RasterContext *ctx);
+bool inside_tile(int i, int j, RasterContext *ctx);
+void account_shade_time(RasterContext *ctx);
 
-void rasterize_from_top(RenderTriangle *T, Color **pixels, double **zbuffer,
-                        int w, int h, Light *light);
-void paint(double x, double y, RenderTriangle *T, Color **pixels,
-           double **zbuffer, int w, int h, Light *light);
+// Gouraud shading utilities
+void light_vertices(Instance *instance, Submission *submission,
+                    RasterContext *ctx);
+void light_vertex_range(void *data, int task, int worker);
+void assign_vertex_colors(void *data, int task, int worker);
 
-// Main function to rasterize a object defined in world space
-Color **rasterize(Object *world_object, Light *light, SpaceConverter *cvt,
-                  int width, int height) {
-  printf("[scanline] Rasterização iniciada.\n");
+// Unshaded modes utilities
+Color unshaded_color(Material *material);
+void plot(int i, int j, Scalar z, Color color, RasterContext *ctx);
+void draw_line(Scalar *A, Scalar *B, Scalar za, Scalar zb, Color color,
+               RasterContext *ctx);
+void rasterize_edges(RenderTriangles *T, int t, RasterContext *ctx);
+void splat_point(Primitive *point, RasterContext *ctx);
 
-  // Initialize z-buffer
-  double **zbuffer = create_zbuffer(width, height);
+// Multisampling utilities
+void create_sample_buffers(RasterContext *ctx);
+EdgeEquation edge_equation(Scalar *A, Scalar *B);
+double evaluate_edge(EdgeEquation *edge, double x, double y);
+void resolve_samples(RasterContext *ctx);
 
-  // Initialize 2D array of pixels
-  Color **pixels = (Color **)malloc(height * sizeof(Color *));
-  for (int i = 0; i < height; i++) {
-    pixels[i] = (Color *)malloc(width * sizeof(Color));
+// Packed output
 
-    // Initially, all pixels are black
-    for (int j = 0; j < width; j++) {
-      pixels[i][j] = black();
+// Occlusion culling utilities
+void rasterize_occlusion_culled(Scene *scene, RasterContext *ctx,
+                                StageJob *job, Submission *submissions,
+                                bool **kept);
+void submit_clusters(Instance *instance, SpaceConverter *cvt,
+                     InstanceVertices **vertices, InstanceClusters *clusters,
+                     ClusterView *views, int pass, bool *kept,
+                     RasterContext *ctx, PrimitiveList *list,
+                     Submission *submission);
+int compare_triangle_indices(const void *a, const void *b);
+
+// Meshlet culling utilities
+bool **cull_scene_meshlets(Scene *scene, RasterContext *ctx);
+bool select_kept_triangles(Object *mesh, bool *kept, Submission *submission);
+
+// Cancellation
+bool is_cancelled(RasterContext *ctx);
+
+RenderOptions default_render_options() {
+  RenderOptions options = {1, NULL, NULL, RENDER_SHADED, SHADING_PHONG,
+                           NULL, NULL, NULL, false};
+  return options;
+}
+
+const char *render_mode_name(RenderMode mode) {
+  switch (mode) {
+  case RENDER_WIREFRAME:
+    return "wireframe";
+  case RENDER_POINTS:
+    return "points";
+  default:
+    return "shaded";
+  }
+}
+
+bool parse_render_mode(const char *name, RenderMode *mode) {
+  RenderMode modes[] = {RENDER_SHADED, RENDER_WIREFRAME, RENDER_POINTS};
+  for (int i = 0; i < 3; i++) {
+    if (strcmp(name, render_mode_name(modes[i])) == 0) {
+      *mode = modes[i];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+const char *shading_model_name(ShadingModel shading) {
+  return (shading == SHADING_GOURAUD) ? "gouraud" : "phong";
+}
+
+bool parse_shading_model(const char *name, ShadingModel *shading) {
+  ShadingModel models[] = {SHADING_PHONG, SHADING_GOURAUD};
+  for (int i = 0; i < 2; i++) {
+    if (strcmp(name, shading_model_name(models[i])) == 0) {
+      *shading = models[i];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Main function to rasterize every object instance of a scene
+Color **rasterize(Scene *scene, int width, int height,
+                  RenderOptions *options, FrameStats *stats) {
+  RenderOptions defaults = default_render_options();
+  options = (options == NULL) ? &defaults : options;
+  if (stats != NULL) {
+    stats->width = width;
+    stats->height = height;
+  }
+
+  // Initialize 2D array of pixels, which are stored
+  //    tile by tile, unless the frame is only packed
+  //    into the target
+  begin_stage(stats, STAGE_SETUP);
+  Color **pixels = NULL;
+  if (options->target == NULL) {
+    pixels = (Color **)malloc(height * sizeof(Color *));
+    for (int i = 0; i < height; i++) {
+      pixels[i] = (Color *)malloc(width * sizeof(Color));
+    }
+  }
+
+  // Assign light sources to screen tiles
+  LightTiles *tiles = cull_light_sources(scene->light, scene->camera, width,
+                                         height, LIGHT_TILE_SIZE);
+
+  // Every tile shares the same array of pixels, while
+  //    each worker has its own depth, colors and samples
+  //    (which only cover the current tile) and stats
+  int samples = (options->mode == RENDER_SHADED) ? options->samples : 1;
+  RasterContext ctx = {pixels, width, height, scene->light, tiles, NULL, stats};
+  ctx.samples = samples;
+  ctx.options = options;
+  int n_workers = scheduler_workers(options->scheduler);
+  FrameStats *worker_stats =
+      (stats != NULL) ? (FrameStats *)calloc(n_workers, sizeof(FrameStats))
+                      : NULL;
+  RasterContext *workers =
+      create_worker_contexts(&ctx, worker_stats, n_workers);
+  end_stage(stats, STAGE_SETUP);
+
+  // Geometry of every instance is processed before
+  //    rasterization, so that tiles are visited once.
+  //    Occlusion culling takes two passes, each one
+  //    with a submission per instance
+  bool occlusion =
+      options->occlusion != NULL && options->mode != RENDER_POINTS;
+  int n_submissions = (occlusion ? 2 : 1) * scene->n_instances;
+  Submission *submissions =
+      (Submission *)calloc(n_submissions, sizeof(Submission));
+  PrimitiveList list = {NULL, NULL, 0, 0};
+  StageJob job = {&ctx};
+  job.list = &list;
+  job.workers = workers;
+  job.worker_stats = worker_stats;
+
+  // Triangles of each instance whose meshlet survived
+  //    culling (every one if NULL)
+  bool **kept = (options->cull_meshlets && options->mode != RENDER_POINTS)
+                    ? cull_scene_meshlets(scene, &ctx)
+                    : NULL;
+
+  if (occlusion) {
+    rasterize_occlusion_culled(scene, &ctx, &job, submissions, kept);
+  } else {
+    for (int i = 0; i < scene->n_instances && !is_cancelled(&ctx); i++) {
+      InstanceVertices *vertices = NULL;
+      if (select_kept_triangles(scene->instances[i].mesh,
+                                (kept != NULL) ? kept[i] : NULL,
+                                submissions + i)) {
+        submit_instance(scene->instances + i, scene->cvt, &vertices, &ctx,
+                        &list, submissions + i);
+      }
+      if (vertices != NULL) {
+        destroy_instance_vertices(vertices);
+      }
+    }
+    rasterize_tiles(&ctx, &job, -1);
+  }
+
+  // Cleanup
+  for (int i = 0; i < n_submissions; i++) {
+    Submission *submission = submissions + i;
+    if (submission->triangles != NULL) {
+      destroy_render_triangles(submission->triangles);
+    }
+    free(submission->setups);
+    free(submission->subset);
+  }
+  free(submissions);
+  if (kept != NULL) {
+    for (int i = 0; i < scene->n_instances; i++) {
+      free(kept[i]);
     }
+    free(kept);
+  }
+  free(list.primitives);
+  free(list.boxes);
+  destroy_light_tiles(tiles);
+  destroy_worker_contexts(workers, n_workers);
+  free(worker_stats);
+
+  if (ctx.cancelled && pixels != NULL) {
+    destroy_canvas(pixels, width, height);
+    return NULL;
+  }
+
+  return pixels;
+}
+
+void submit_instance(Instance *instance, SpaceConverter *cvt,
+                     InstanceVertices **vertices, RasterContext *ctx,
+                     PrimitiveList *list, Submission *submission) {
+  int n_triangles = submission->n_triangles;
+  ctx->material = instance->material;
+
+  // Point mode doesn't need triangles at all
+  if (ctx->options->mode == RENDER_POINTS) {
+    submit_points(instance, cvt, ctx, list);
+    return;
   }
 
   // Obtain the Triangles with all information required to render
-  //    them (e.g., camera space, projection, window, normals)
-  printf("[scanline] Calculando triângulo de renderização.\n");
-  RenderTriangle *triangles =
-      triangles_from_world_object(world_object, cvt, width, height);
-
-  // Rasterize object to 2D array of pixels
-  printf("[scanline] Iniciando rasterização dos triângulos.\n");
-  for (int i = 0; i < world_object->n_triangles; i++) {
-    // Obtain render triangle i
-    RenderTriangle *t = triangles + i;
-
-    // Ensure that v1.y <= v2.y <= v3.y
-    sort_vertices_by_window_y(t);
-
-    // Check for special cases
-    if (!is_valid_triangle(t->window[0], t->window[1], t->window[2])) {
-      // TODO: add line rasterizer
-    } else if (is_horizontal(t->window[0], t->window[1])) {
-      rasterize_from_bottom(t, pixels, zbuffer, width, height, light);
-    } else if (is_horizontal(t->window[1], t->window[2])) {
-      rasterize_from_top(t, pixels, zbuffer, width, height, light);
+  //    them (e.g., camera space, projection, window, normals).
+  //    The vertices are transformed by the first submission
+  //    of the instance and shared by the next ones
+  bool wireframe = ctx->options->mode == RENDER_WIREFRAME;
+  TaskScheduler *scheduler = ctx->options->scheduler;
+  if (*vertices == NULL) {
+    *vertices = transform_instance(instance, cvt, ctx->w, ctx->h, !wireframe,
+                                   scheduler, ctx->stats);
+  }
+  RenderTriangles *triangles = gather_triangles(
+      *vertices, submission->subset, n_triangles, scheduler, ctx->stats);
+  submission->triangles = triangles;
+
+  // Gouraud shading lights each vertex once,
+  //    before rasterization
+  if (!wireframe && ctx->options->shading == SHADING_GOURAUD) {
+    light_vertices(instance, submission, ctx);
+  }
+
+  // Setup each triangle in parallel, into an array that
+  //    lives until the end of the frame, then submit the
+  //    ones that can produce fragments (in order)
+  begin_stage(ctx->stats, STAGE_SETUP);
+  StageJob job = {ctx, instance, cvt, triangles, submission->subset,
+                  n_triangles};
+  job.setups = (TriangleSetup *)malloc(n_triangles * sizeof(TriangleSetup));
+  assert(job.setups != NULL);
+  parallel_for(scheduler, count_tasks(n_triangles), setup_triangles, &job);
+  submission->setups = job.setups;
+
+  long degenerate = 0, culled = 0;
+  for (int i = 0; i < n_triangles; i++) {
+    TriangleSetup *setup = job.setups + i;
+    degenerate += setup->degenerate;
+    culled += setup->culled;
+    if (setup->visible) {
+      Primitive primitive = {triangles, i, setup, ctx->material};
+      append_primitive(list, primitive, setup->box);
+    }
+  }
+  end_stage(ctx->stats, STAGE_SETUP);
+
+  if (ctx->stats != NULL) {
+    ctx->stats->triangles_in += n_triangles;
+    ctx->stats->triangles_degenerate += degenerate;
+    ctx->stats->triangles_culled += culled;
+  }
+}
+
+void setup_triangles(void *data, int task, int worker) {
+  StageJob *job = (StageJob *)data;
+  RasterContext *ctx = job->ctx;
+  bool wireframe = ctx->options->mode == RENDER_WIREFRAME;
+  int first, last;
+  task_range(task, job->n_triangles, &first, &last);
+
+  for (int i = first; i < last; i++) {
+    Scalar(*window)[2] = job->triangles->window + 3 * i;
+    TriangleSetup *setup = job->setups + i;
+    setup->visible = true;
+    setup->degenerate = false;
+    setup->culled = false;
+    setup->fixed = false;
+
+    bool outside = is_outside_window(job->triangles, i, ctx->w, ctx->h);
+    if (!is_valid_triangle(window[0], window[1], window[2])) {
+      // Degenerate triangles don't cover any pixel
+      //    when shaded, but their edges are still
+      //    drawn in wireframe mode
+      setup->visible = wireframe && !outside;
+      setup->degenerate = true;
+    } else if (outside) {
+      setup->visible = false;
+      setup->culled = true;
+    }
+
+    if (!setup->visible) {
+      continue;
+    }
+    setup->box = triangle_box(job->triangles, i, ctx->w, ctx->h);
+
+    // Edge equations, used by the multisampled
+    //    rasterizer to obtain coverage and the
+    //    barycentric weights of each sample
+    setup->edges[0] = edge_equation(window[1], window[2]);
+    setup->edges[1] = edge_equation(window[2], window[0]);
+    setup->edges[2] = edge_equation(window[0], window[1]);
+    setup->inv_area =
+        1.0 / evaluate_edge(setup->edges + 2, window[2][0], window[2][1]);
+
+    // Triangles that collapse once snapped to the
+    //    subpixel grid don't cover any sample
+    if (!wireframe && setup_fixed_edges(window, setup) &&
+        setup->fixed_area == 0) {
+      setup->visible = false;
+      setup->degenerate = true;
+    }
+  }
+}
+
+bool setup_fixed_edges(Scalar (*window)[2], TriangleSetup *setup) {
+  // Vertices snapped to the subpixel grid, unless
+  //    one of them is beyond the guard band
+  int64_t x[3], y[3];
+  for (int k = 0; k < 3; k++) {
+    double wx = window[k][0], wy = window[k][1];
+    if (!(fabs(wx) <= GUARD_BAND && fabs(wy) <= GUARD_BAND)) {
+      return false;
+    }
+    x[k] = (int64_t)llround(wx * SUBPIXEL_SCALE);
+    y[k] = (int64_t)llround(wy * SUBPIXEL_SCALE);
+  }
+
+  // Edge k goes from vertex k + 1 to vertex k + 2, and
+  //    its function is twice the signed area of the
+  //    triangle formed by the edge and the point
+  for (int k = 0; k < 3; k++) {
+    int a = (k + 1) % 3, b = (k + 2) % 3;
+    FixedEdge *edge = setup->fixed_edges + k;
+    edge->a = -(y[b] - y[a]);
+    edge->b = x[b] - x[a];
+    edge->c = -(edge->a * x[a] + edge->b * y[a]);
+  }
+
+  // Flip the edges of clockwise triangles, so that
+  //    the inside is positive regardless of the winding
+  FixedEdge *last = setup->fixed_edges + 2;
+  int64_t area = last->a * x[2] + last->b * y[2] + last->c;
+  if (area < 0) {
+    for (int k = 0; k < 3; k++) {
+      setup->fixed_edges[k].a = -setup->fixed_edges[k].a;
+      setup->fixed_edges[k].b = -setup->fixed_edges[k].b;
+      setup->fixed_edges[k].c = -setup->fixed_edges[k].c;
+    }
+    area = -area;
+  }
+
+  // Top-left rule: samples exactly on an edge belong
+  //    to the triangle only if it's a left edge (the
+  //    inside is to its right) or a horizontal top
+  //    edge (the inside is below it), so that samples
+  //    on an edge shared by two triangles are covered
+  //    by exactly one of them
+  for (int k = 0; k < 3; k++) {
+    FixedEdge *edge = setup->fixed_edges + k;
+    bool top_left = edge->a > 0 || (edge->a == 0 && edge->b > 0);
+    edge->bias = top_left ? 0 : -1;
+  }
+
+  setup->fixed_area = area;
+  setup->fixed = true;
+  return true;
+}
+
+void append_primitive(PrimitiveList *list, Primitive primitive,
+                      BoundingBox box) {
+  if (list->n == list->capacity) {
+    list->capacity = (list->capacity == 0) ? 1024 : 2 * list->capacity;
+    list->primitives = (Primitive *)realloc(
+        list->primitives, list->capacity * sizeof(Primitive));
+    list->boxes = (BoundingBox *)realloc(list->boxes,
+                                         list->capacity * sizeof(BoundingBox));
+    assert(list->primitives != NULL && list->boxes != NULL);
+  }
+
+  list->primitives[list->n] = primitive;
+  list->boxes[list->n] = box;
+  list->n++;
+}
+
+BoundingBox triangle_box(RenderTriangles *T, int t, int width, int height) {
+  Scalar(*window)[2] = T->window + 3 * t;
+  double min_x = window[0][0], max_x = min_x;
+  double min_y = window[0][1], max_y = min_y;
+  for (int i = 1; i < 3; i++) {
+    min_x = fmin(min_x, window[i][0]);
+    max_x = fmax(max_x, window[i][0]);
+    min_y = fmin(min_y, window[i][1]);
+    max_y = fmax(max_y, window[i][1]);
+  }
+
+  // Window coordinates might not be finite
+  //    (e.g., degenerate projections)
+  BoundingBox box = {0, 0, -1, -1};
+  if (isfinite(min_x) && isfinite(max_x) && isfinite(min_y) &&
+      isfinite(max_y)) {
+    box.min_x = (int)fmax(0.0, floor(min_x));
+    box.min_y = (int)fmax(0.0, floor(min_y));
+    box.max_x = (int)fmin(width - 1, floor(max_x));
+    box.max_y = (int)fmin(height - 1, floor(max_y));
+  }
+
+  return box;
+}
+
+RasterContext *create_worker_contexts(RasterContext *ctx, FrameStats *stats,
+                                      int n_workers) {
+  RasterContext *workers =
+      (RasterContext *)malloc(n_workers * sizeof(RasterContext));
+  assert(workers != NULL);
+
+  for (int w = 0; w < n_workers; w++) {
+    RasterContext *worker = workers + w;
+    *worker = *ctx;
+    worker->stats = (stats != NULL) ? stats + w : NULL;
+    worker->depth =
+        (Scalar *)malloc(BIN_TILE_SIZE * BIN_TILE_SIZE * sizeof(Scalar));
+    worker->colors =
+        (Color *)malloc(BIN_TILE_SIZE * BIN_TILE_SIZE * sizeof(Color));
+    assert(worker->depth != NULL && worker->colors != NULL);
+    worker->sample_depth = NULL;
+    worker->sample_colors = NULL;
+    create_sample_buffers(worker);
+  }
+
+  return workers;
+}
+
+void destroy_worker_contexts(RasterContext *workers, int n_workers) {
+  for (int w = 0; w < n_workers; w++) {
+    free(workers[w].depth);
+    free(workers[w].colors);
+    free(workers[w].sample_depth);
+    free(workers[w].sample_colors);
+  }
+  free(workers);
+}
+
+void rasterize_tiles(RasterContext *ctx, StageJob *job, int first_new) {
+  RenderOptions *options = ctx->options;
+  FrameStats *stats = ctx->stats;
+  PrimitiveList *list = job->list;
+
+  // Sort-middle: bin every primitive (from first_new
+  //    on, if it isn't negative) into the screen tiles
+  //    it overlaps
+  begin_stage(stats, STAGE_SETUP);
+  job->first = (first_new >= 0) ? first_new : 0;
+  int n = list->n - job->first;
+  int n_chunks = (n + BIN_CHUNK_SIZE - 1) / BIN_CHUNK_SIZE;
+  TriangleBins *bins = bin_primitives(
+      list->boxes + job->first, n, ctx->w, ctx->h, BIN_TILE_SIZE,
+      n_chunks > 0 ? n_chunks : 1, options->scheduler);
+  int n_tiles = bins->tiles_x * bins->tiles_y;
+  job->bins = bins;
+
+  // If first_new isn't negative, the primitives are
+  //    drawn on top of the saved tiles, so only the
+  //    tiles they overlap are rasterized
+  int n_tasks = n_tiles;
+  job->tiles = NULL;
+  if (first_new >= 0) {
+    job->tiles = (int *)malloc(n_tiles * sizeof(int));
+    assert(job->tiles != NULL);
+    n_tasks = 0;
+    for (int t = 0; t < n_tiles; t++) {
+      if (bins->offsets[t + 1] > bins->offsets[t]) {
+        job->tiles[n_tasks++] = t;
+      }
+    }
+  }
+  end_stage(stats, STAGE_SETUP);
+
+  // Rasterize tile by tile, where each tile is a task.
+  //    Tiles are independent, so the workers don't
+  //    need to synchronize
+  begin_stage(stats, STAGE_RASTER);
+  int n_workers = scheduler_workers(options->scheduler);
+  double start = now_seconds();
+  if (!is_cancelled(ctx)) {
+    parallel_for(options->scheduler, n_tasks, rasterize_tile_task, job);
+  }
+  merge_worker_stats(stats, job->worker_stats, n_workers, STAGE_RASTER,
+                     now_seconds() - start);
+  for (int w = 0; w < n_workers; w++) {
+    ctx->cancelled = ctx->cancelled || job->workers[w].cancelled;
+  }
+
+  // Worker stats were merged, so they're cleared
+  //    before the next pass
+  if (job->worker_stats != NULL) {
+    memset(job->worker_stats, 0, n_workers * sizeof(FrameStats));
+  }
+  end_stage(stats, STAGE_RASTER);
+
+  // Cleanup
+  free(job->tiles);
+  job->tiles = NULL;
+  destroy_triangle_bins(bins);
+  job->bins = NULL;
+}
+
+void rasterize_tile_task(void *data, int task, int worker) {
+  StageJob *job = (StageJob *)data;
+  RasterContext *ctx = job->workers + worker;
+
+  // Once cancelled, the remaining tiles are skipped
+  if (is_cancelled(ctx)) {
+    return;
+  }
+
+  // The first pass of occlusion culling saves the
+  //    tiles it draws, and the second one resumes them
+  int t = (job->tiles != NULL) ? job->tiles[task] : task;
+  SavedTile *saved = (job->saved != NULL) ? job->saved + t : NULL;
+  bool empty = job->bins->offsets[t] == job->bins->offsets[t + 1];
+  begin_stage(ctx->stats, STAGE_RASTER);
+  rasterize_tile(job->bins, t, job->list->primitives + job->first,
+                 (job->pass == 2) ? saved : NULL, ctx);
+  account_shade_time(ctx);
+  if (job->pass == 1 && saved != NULL && !empty) {
+    save_tile(saved, ctx);
+  }
+  if (!is_cancelled(ctx)) {
+    store_tile(ctx);
+  }
+
+  // Empty tiles don't clear their depth
+  if (job->pyramid != NULL && !is_cancelled(ctx)) {
+    Scalar *depth = (ctx->samples > 1) ? ctx->sample_depth : ctx->depth;
+    store_tile_depth(job->pyramid, ctx->x0, ctx->y0, ctx->x1, ctx->y1,
+                     empty ? NULL : depth, BIN_TILE_SIZE, ctx->samples);
+  }
+  end_stage(ctx->stats, STAGE_RASTER);
+}
+
+void rasterize_tile(TriangleBins *bins, int t, Primitive *primitives,
+                    SavedTile *saved, RasterContext *ctx) {
+  tile_bounds(bins, t, ctx->w, ctx->h, &ctx->x0, &ctx->y0, &ctx->x1,
+              &ctx->y1);
+  int first = bins->offsets[t], last = bins->offsets[t + 1];
+  int n_samples = BIN_TILE_SIZE * BIN_TILE_SIZE * ctx->samples;
+
+  if (saved != NULL && saved->depth != NULL) {
+    // Resume a saved tile, whose pixels are
+    //    still in the frame
+    if (ctx->samples > 1) {
+      memcpy(ctx->sample_depth, saved->depth, n_samples * sizeof(Scalar));
+      memcpy(ctx->sample_colors, saved->colors, n_samples * sizeof(Color));
     } else {
-      // We must divide the rectangle
-      //    by a horizontal line
-      // Since v1.y <= v2.y <= v3.y and
-      //    there aren't degenerate triangles,
-      //    the vertex v2 can be chosen to create
-      //    a horizontal line.
-      Vector *v4 = copy_vector(t->window[1], NULL);
-
-      // The y-coordinate is the same as v2
-      // The x-coordinate is found by the interception
-      //    with the edge v1,3
-      double slope = get_slope(t->window[0], t->window[2]);
-      if (fabs(slope) <= 0.0001) {
-        // There's a vertical line from v1.x and v3.x,
-        //  which means that v4.x = v1.x = v3.x
-        *v4->x = *t->window[0]->x;
-      } else {
-        // Otherwise, find the interception using
-        //  the line equation
-        double b = *t->window[0]->y - slope * (*t->window[0]->x);
-        *v4->x = (*v4->y - b) / slope;
+      memcpy(ctx->depth, saved->depth, n_samples * sizeof(Scalar));
+      load_tile(ctx);
+    }
+  } else {
+    // Initially, all pixels are black
+    for (int k = 0; k < BIN_TILE_SIZE * BIN_TILE_SIZE; k++) {
+      ctx->colors[k] = black();
+    }
+
+    // Tiles without primitives are done
+    if (first == last) {
+      return;
+    }
+
+    // Initially, the tile is infinitely far away
+    for (int k = 0; k < BIN_TILE_SIZE * BIN_TILE_SIZE; k++) {
+      ctx->depth[k] = INFINITY;
+    }
+    if (ctx->samples > 1) {
+      for (int k = 0; k < n_samples; k++) {
+        ctx->sample_depth[k] = INFINITY;
+        ctx->sample_colors[k] = black();
+      }
+    }
+  }
+
+  for (int k = first; k < last; k++) {
+    if ((k - first) % CANCEL_INTERVAL == 0 && is_cancelled(ctx)) {
+      return;
+    }
+
+    Primitive *primitive = primitives + bins->indices[k];
+    ctx->material = primitive->material;
+    if (primitive->triangles == NULL) {
+      splat_point(primitive, ctx);
+    } else if (ctx->options->mode == RENDER_WIREFRAME) {
+      rasterize_edges(primitive->triangles, primitive->t, ctx);
+    } else {
+      rasterize_triangle(primitive, ctx);
+    }
+  }
+
+  // Average the samples of each pixel
+  resolve_samples(ctx);
+}
+
+void save_tile(SavedTile *saved, RasterContext *ctx) {
+  int n_samples = BIN_TILE_SIZE * BIN_TILE_SIZE * ctx->samples;
+  Scalar *depth = (ctx->samples > 1) ? ctx->sample_depth : ctx->depth;
+  saved->depth = (Scalar *)malloc(n_samples * sizeof(Scalar));
+  assert(saved->depth != NULL);
+  memcpy(saved->depth, depth, n_samples * sizeof(Scalar));
+
+  if (ctx->samples > 1) {
+    saved->colors = (Color *)malloc(n_samples * sizeof(Color));
+    assert(saved->colors != NULL);
+    memcpy(saved->colors, ctx->sample_colors, n_samples * sizeof(Color));
+  }
+}
+
+void load_tile(RasterContext *ctx) {
+  // Either from the pixels or from the target
+  for (int i = ctx->y0; i < ctx->y1; i++) {
+    Color *dst = ctx->colors + (i - ctx->y0) * BIN_TILE_SIZE;
+    if (ctx->pixels != NULL) {
+      memcpy(dst, ctx->pixels[i] + ctx->x0,
+             (ctx->x1 - ctx->x0) * sizeof(Color));
+      continue;
+    }
+
+    uint8_t *src = ctx->options->target + (size_t)4 * ctx->w * i;
+    for (int j = ctx->x0; j < ctx->x1; j++) {
+      Color c = {src[4 * j], src[4 * j + 1], src[4 * j + 2], 255};
+      dst[j - ctx->x0] = c;
+    }
+  }
+}
+
+void store_tile(RasterContext *ctx) {
+  // The tile is still in cache, so packing it here
+  //    avoids another pass over the whole frame
+  for (int i = ctx->y0; i < ctx->y1; i++) {
+    Color *src = ctx->colors + (i - ctx->y0) * BIN_TILE_SIZE;
+    if (ctx->pixels != NULL) {
+      memcpy(ctx->pixels[i] + ctx->x0, src,
+             (ctx->x1 - ctx->x0) * sizeof(Color));
+    }
+    if (ctx->options->target == NULL) {
+      continue;
+    }
+
+    uint8_t *dst = ctx->options->target + (size_t)4 * ctx->w * i;
+    for (int j = ctx->x0; j < ctx->x1; j++) {
+      Color c = src[j - ctx->x0];
+      dst[4 * j] = (uint8_t)(c.r < 0 ? 0 : (c.r > 255 ? 255 : c.r));
+      dst[4 * j + 1] = (uint8_t)(c.g < 0 ? 0 : (c.g > 255 ? 255 : c.g));
+      dst[4 * j + 2] = (uint8_t)(c.b < 0 ? 0 : (c.b > 255 ? 255 : c.b));
+      dst[4 * j + 3] = 255;
+    }
+  }
+}
+
+void rasterize_triangle(Primitive *primitive, RasterContext *ctx) {
+  // Single sample and multisampling share the
+  //    rasterizer, the former with one sample at
+  //    the center of each pixel
+  if (primitive->setup->fixed) {
+    rasterize_fixed(primitive, ctx);
+  } else {
+    rasterize_float(primitive, ctx);
+  }
+}
+
+void rasterize_fixed(Primitive *primitive, RasterContext *ctx) {
+  TriangleSetup *setup = primitive->setup;
+
+  // Pixels of the bounding box inside the tile
+  int first_row = (setup->box.min_y > ctx->y0) ? setup->box.min_y : ctx->y0;
+  int last_row = (setup->box.max_y < ctx->y1) ? setup->box.max_y : ctx->y1 - 1;
+  int first_col = (setup->box.min_x > ctx->x0) ? setup->box.min_x : ctx->x0;
+  int last_col = (setup->box.max_x < ctx->x1) ? setup->box.max_x : ctx->x1 - 1;
+  if (first_row > last_row || first_col > last_col) {
+    return;
+  }
+
+  // Edge functions at the top-left corner of the first
+  //    pixel, their steps between pixels and the offset
+  //    of each sample from the corner
+  FixedEdge *edges = setup->fixed_edges;
+  int64_t row[3], step_x[3], step_y[3], offsets[3][MAX_SAMPLES];
+  for (int k = 0; k < 3; k++) {
+    step_x[k] = edges[k].a * SUBPIXEL_SCALE;
+    step_y[k] = edges[k].b * SUBPIXEL_SCALE;
+    row[k] = step_x[k] * first_col + step_y[k] * first_row + edges[k].c;
+    for (int s = 0; s < ctx->samples; s++) {
+      int64_t sx = (int64_t)(ctx->positions[s][0] * SUBPIXEL_SCALE);
+      int64_t sy = (int64_t)(ctx->positions[s][1] * SUBPIXEL_SCALE);
+      offsets[k][s] = edges[k].a * sx + edges[k].b * sy;
+    }
+  }
+
+  // The barycentric weights are the edge functions
+  //    divided by twice the area
+  double inv_area = 1.0 / (double)setup->fixed_area;
+
+  for (int i = first_row; i <= last_row; i++) {
+    int64_t e[3] = {row[0], row[1], row[2]};
+    for (int j = first_col; j <= last_col; j++) {
+      double weights[MAX_SAMPLES][3];
+      double centroid[3] = {0.0, 0.0, 0.0};
+      unsigned int coverage = 0;
+      int n_covered = 0;
+
+      // Coverage mask, following the top-left rule
+      for (int s = 0; s < ctx->samples; s++) {
+        int64_t e0 = e[0] + offsets[0][s];
+        int64_t e1 = e[1] + offsets[1][s];
+        int64_t e2 = e[2] + offsets[2][s];
+        if (e0 + edges[0].bias >= 0 && e1 + edges[1].bias >= 0 &&
+            e2 + edges[2].bias >= 0) {
+          coverage |= 1u << s;
+          weights[s][0] = e0 * inv_area;
+          weights[s][1] = e1 * inv_area;
+          weights[s][2] = e2 * inv_area;
+          for (int k = 0; k < 3; k++) {
+            centroid[k] += weights[s][k];
+          }
+          n_covered++;
+        }
+      }
+
+      if (coverage != 0) {
+        // Weights of the centroid of the covered
+        //    samples (which lies inside the triangle)
+        for (int k = 0; k < 3; k++) {
+          centroid[k] /= n_covered;
+        }
+        shade_samples(primitive, i, j, coverage, weights, centroid, ctx);
+      }
+
+      for (int k = 0; k < 3; k++) {
+        e[k] += step_x[k];
+      }
+    }
+
+    for (int k = 0; k < 3; k++) {
+      row[k] += step_y[k];
+    }
+  }
+}
+
+void rasterize_float(Primitive *primitive, RasterContext *ctx) {
+  // Same as rasterize_fixed, for the triangles outside
+  //    the guard band, whose edge functions are
+  //    evaluated in floating point
+  TriangleSetup *setup = primitive->setup;
+  int first_row = (setup->box.min_y > ctx->y0) ? setup->box.min_y : ctx->y0;
+  int last_row = (setup->box.max_y < ctx->y1) ? setup->box.max_y : ctx->y1 - 1;
+  int first_col = (setup->box.min_x > ctx->x0) ? setup->box.min_x : ctx->x0;
+  int last_col = (setup->box.max_x < ctx->x1) ? setup->box.max_x : ctx->x1 - 1;
+  EdgeEquation *edges = setup->edges;
+  double inv_area = setup->inv_area;
+
+  // Top-left rule, where the gradient of each weight
+  //    points to the inside
+  bool top_left[3];
+  for (int k = 0; k < 3; k++) {
+    double gx = -edges[k].dy * inv_area, gy = edges[k].dx * inv_area;
+    top_left[k] = gx > 0.0 || (gx == 0.0 && gy > 0.0);
+  }
+
+  for (int i = first_row; i <= last_row; i++) {
+    for (int j = first_col; j <= last_col; j++) {
+      double weights[MAX_SAMPLES][3];
+      double centroid[3] = {0.0, 0.0, 0.0};
+      unsigned int coverage = 0;
+      int n_covered = 0;
+
+      for (int s = 0; s < ctx->samples; s++) {
+        double x = j + ctx->positions[s][0];
+        double y = i + ctx->positions[s][1];
+        double *w = weights[s];
+        w[0] = evaluate_edge(edges, x, y) * inv_area;
+        w[1] = evaluate_edge(edges + 1, x, y) * inv_area;
+        w[2] = evaluate_edge(edges + 2, x, y) * inv_area;
+        bool inside = true;
+        for (int k = 0; k < 3; k++) {
+          inside = inside && (w[k] > 0.0 || (w[k] == 0.0 && top_left[k]));
+        }
+        if (inside) {
+          coverage |= 1u << s;
+          for (int k = 0; k < 3; k++) {
+            centroid[k] += w[k];
+          }
+          n_covered++;
+        }
       }
 
-      // Guarantee that v4 is valid
-      assert(isfinite(*v4->y));
-      assert(isfinite(*v4->x));
+      if (coverage != 0) {
+        for (int k = 0; k < 3; k++) {
+          centroid[k] /= n_covered;
+        }
+        shade_samples(primitive, i, j, coverage, weights, centroid, ctx);
+      }
+    }
+  }
+}
+
+void shade_samples(Primitive *primitive, int i, int j, unsigned int coverage,
+                   double weights[][3], double *centroid, RasterContext *ctx) {
+  RenderTriangles *T = primitive->triangles;
+  int t = primitive->t;
+  Scalar(*camera)[3] = T->camera + 3 * t;
+
+  // A single sample lives in the tile depth buffer
+  //    and pixels, multiple ones in the sample buffers
+  int samples = ctx->samples;
+  int pixel = (i - ctx->y0) * BIN_TILE_SIZE + (j - ctx->x0);
+  Scalar *depth =
+      ((samples > 1) ? ctx->sample_depth : ctx->depth) + pixel * samples;
+
+  // Depth test of each covered sample
+  Scalar z[MAX_SAMPLES];
+  unsigned int passed = 0;
+  for (int s = 0; s < samples; s++) {
+    if (coverage & (1u << s)) {
+      z[s] = weights[s][0] * camera[0][2] + weights[s][1] * camera[1][2] +
+             weights[s][2] * camera[2][2];
+      passed |= (z[s] < depth[s]) ? (1u << s) : 0;
+    }
+  }
+
+  if (ctx->stats != NULL) {
+    ctx->stats->fragments_tested++;
+    ctx->stats->fragments_passed += passed != 0;
+  }
+
+  if (passed == 0) {
+    return;
+  }
+
+  // Shade once per pixel, at the given weights. Only
+  //    some pixels are timed, since reading the clock
+  //    costs about as much as shading with few lights
+  bool timed = ctx->stats != NULL && ctx->shaded % SHADE_TIMING_INTERVAL == 0;
+  double start = timed ? now_seconds() : 0.0;
+  BarycentricCoordinates coords = {centroid[0], centroid[1], centroid[2]};
+  Color color;
+  if (T->colors != NULL) {
+    // Gouraud: interpolate the lit vertex colors
+    color = interpolate_color(&coords, T, t);
+  } else {
+    // Phong: only evaluate the light sources
+    //    that might reach this pixel
+    Scalar camera_space[3], N[3];
+    interpolate_to_camera_space_into(&coords, T, t, camera_space);
+    interpolate_normal_into(&coords, T, t, N);
+    int n_sources = 0;
+    int *sources = light_sources_at(ctx->tiles, j, i, &n_sources);
+    color = color_from_arrays(camera_space, N, ctx->light, ctx->material,
+                              sources, n_sources);
+  }
+
+  if (timed) {
+    ctx->shade_time += now_seconds() - start;
+    ctx->timed++;
+  }
+  ctx->shaded++;
+  if (ctx->stats != NULL) {
+    ctx->stats->pixels_shaded++;
+  }
+
+  // Store the color in every visible sample
+  for (int s = 0; s < samples; s++) {
+    if (passed & (1u << s)) {
+      depth[s] = z[s];
+      if (samples > 1) {
+        ctx->sample_colors[pixel * samples + s] = color;
+      }
+    }
+  }
+  if (samples == 1) {
+    ctx->colors[pixel] = color;
+  }
+}
 
-      // Guarantee that the new vertex
-      //    is a horizontal line with v2
-      assert(is_horizontal(t->window[1], v4));
+bool inside_tile(int i, int j, RasterContext *ctx) {
+  return j >= ctx->x0 && j < ctx->x1 && i >= ctx->y0 && i < ctx->y1;
+}
 
-      // Obtain the barycentric coordinates of v4
-      BarycentricCoordinates coords = get_bcoordinates_from_window(v4, t);
+void account_shade_time(RasterContext *ctx) {
+  // Move the (extrapolated) shading time of the
+  //    tile out of the raster stage
+  if (ctx->stats != NULL && ctx->timed > 0) {
+    double shade = ctx->shade_time * ctx->shaded / ctx->timed;
+    ctx->stats->time[STAGE_SHADE] += shade;
+    ctx->stats->time[STAGE_RASTER] -= shade;
+  }
 
-      // Interpolate the point to camera space
-      Vector *camera_v4 = interpolate_to_camera_space(&coords, t);
+  ctx->shaded = 0;
+  ctx->timed = 0;
+  ctx->shade_time = 0.0;
+}
 
-      // Interpolate the normal at this point
-      Vector *normal_v4 = interpolate_normal(&coords, t);
+void light_vertices(Instance *instance, Submission *submission,
+                    RasterContext *ctx) {
+  Object *mesh = instance->mesh;
+  RenderTriangles *triangles = submission->triangles;
+  begin_stage(ctx->stats, STAGE_SHADE);
 
-      // Now, we can rasterize two sub-triangles
-      // First the top
-      Vector *c1[3] = {t->camera[0], t->camera[1], camera_v4};
-      Vector *cn1[3] = {t->camera_normals[0], t->camera_normals[1], normal_v4};
-      Vector *w1[3] = {t->window[0], t->window[1], v4};
-      RenderTriangle t1 = {NULL, c1, cn1, NULL, w1};
-      assert(is_valid_triangle(w1[0], w1[1], w1[2]));
-      rasterize_from_top(&t1, pixels, zbuffer, width, height, light);
+  // Each vertex is lit only by the sources whose
+  //    radius reaches it (light tiles are per pixel,
+  //    and a vertex might lie outside the window)
+  StageJob job = {ctx, instance, NULL, triangles, submission->subset,
+                  submission->n_triangles};
 
-      // Then the bottom
-      Vector *c2[3] = {camera_v4, t->camera[1], t->camera[2]};
-      Vector *cn2[3] = {normal_v4, t->camera_normals[1], t->camera_normals[2]};
-      Vector *w2[3] = {v4, t->window[1], t->window[2]};
-      RenderTriangle t2 = {NULL, c2, cn2, NULL, w2};
-      assert(is_valid_triangle(w2[0], w2[1], w2[2]));
-      rasterize_from_bottom(&t2, pixels, zbuffer, width, height, light);
+  // Shared vertices are lit only once, since they
+  //    have the same normal in every triangle. Each
+  //    one is lit with the data of the first valid
+  //    triangle where it appears
+  job.owners = (int *)malloc(mesh->n_vertices * sizeof(int));
+  job.colors = (Color *)malloc(mesh->n_vertices * sizeof(Color));
+  for (int v = 0; v < mesh->n_vertices; v++) {
+    job.owners[v] = -1;
+  }
+  for (int i = 0; i < job.n_triangles; i++) {
+    // Degenerate triangles don't have normals
+    Scalar(*window)[2] = triangles->window + 3 * i;
+    if (!is_valid_triangle(window[0], window[1], window[2])) {
+      continue;
+    }
 
-      // Cleanup
-      destroy_vector(v4);
-      destroy_vector(camera_v4);
-      destroy_vector(normal_v4);
+    for (int v = 0; v < 3; v++) {
+      uint32_t index = triangles->vertices[3 * i + v];
+      if (job.owners[index] < 0) {
+        job.owners[index] = 3 * i + v;
+      }
     }
   }
 
+  // Light the vertices, then copy their colors
+  //    to the triangles
+  triangles->colors = (Color *)malloc(3 * job.n_triangles * sizeof(Color));
+  assert(triangles->colors != NULL);
+  TaskScheduler *scheduler = ctx->options->scheduler;
+  parallel_for(scheduler, count_tasks(mesh->n_vertices), light_vertex_range,
+               &job);
+  parallel_for(scheduler, count_tasks(job.n_triangles), assign_vertex_colors,
+               &job);
+  end_stage(ctx->stats, STAGE_SHADE);
+
   // Cleanup
-  destroy_zbuffer(zbuffer, width, height);
-  destroy_render_triangles(triangles, world_object->n_triangles);
+  free(job.owners);
+  free(job.colors);
+}
 
-  return pixels;
+void light_vertex_range(void *data, int task, int worker) {
+  StageJob *job = (StageJob *)data;
+  RasterContext *ctx = job->ctx;
+  int first, last;
+  task_range(task, job->instance->mesh->n_vertices, &first, &last);
+  int *sources = (int *)malloc((ctx->light->n_sources + 1) * sizeof(int));
+
+  for (int v = first; v < last; v++) {
+    int owner = job->owners[v];
+    if (owner < 0) {
+      continue;
+    }
+
+    Scalar *P = job->triangles->camera[owner];
+    int n_sources = light_sources_reaching(ctx->light, P, sources);
+    job->colors[v] =
+        color_from_arrays(P, job->triangles->normals[owner], ctx->light,
+                          ctx->material, sources, n_sources);
+  }
+
+  free(sources);
 }
 
-void paint(double x, double y, RenderTriangle *T, Color **pixels,
-           double **zbuffer, int w, int h, Light *light) {
-  // Obtain barycentric coordinates of the
-  //    current point (x, y)
-  Vector *P = create_vector(2, POINT, x, y);
-  BarycentricCoordinates coords = get_bcoordinates_from_window(P, T);
+void assign_vertex_colors(void *data, int task, int worker) {
+  StageJob *job = (StageJob *)data;
+  RenderTriangles *T = job->triangles;
+  int first, last;
+  task_range(task, job->n_triangles, &first, &last);
 
-  // Obtain current point in camera space
-  Vector *camera_space = interpolate_to_camera_space(&coords, T);
+  // Corners of degenerate triangles (whose vertices
+  //    might not be lit) are never shaded
+  for (int corner = 3 * first; corner < 3 * last; corner++) {
+    int owner = job->owners[T->vertices[corner]];
+    T->colors[corner] = (owner >= 0) ? job->colors[T->vertices[corner]]
+                                     : black();
+  }
+}
 
-  // Obtain z-value
-  double z = *camera_space->z;
+Color unshaded_color(Material *material) {
+  // Diffuse albedo of the material
+  Color c = {(int)(255 * *material->kd->x * *material->od->x),
+             (int)(255 * *material->kd->y * *material->od->y),
+             (int)(255 * *material->kd->z * *material->od->z), 255};
+  return c;
+}
 
-  // Convert continuous points to discrete
-  //    ones through floor
-  int i = (int)floor(y);
-  int j = (int)floor(x);
+void plot(int i, int j, Scalar z, Color color, RasterContext *ctx) {
+  if (!inside_tile(i, j, ctx)) {
+    return;
+  }
 
-  // Check whether this point should be drawn
-  bool inside_window = j < w && j >= 0;
-  inside_window = inside_window && i < h && i >= 0;
+  int pixel = (i - ctx->y0) * BIN_TILE_SIZE + (j - ctx->x0);
+  Scalar *depth = ctx->depth + pixel;
+  bool in_front = z < *depth;
+  if (ctx->stats != NULL) {
+    ctx->stats->fragments_tested++;
+    ctx->stats->fragments_passed += in_front;
+  }
 
-  if (inside_window) {
-    bool in_front = z < zbuffer[i][j];
+  if (in_front) {
+    *depth = z;
+    ctx->colors[pixel] = color;
+  }
+}
 
-    if (in_front) {
-      // Update z-buffer
-      zbuffer[i][j] = z;
+void draw_line(Scalar *A, Scalar *B, Scalar za, Scalar zb, Color color,
+               RasterContext *ctx) {
+  double x0 = A[0], y0 = A[1];
+  double dx = B[0] - x0, dy = B[1] - y0;
+  if (!isfinite(x0) || !isfinite(y0) || !isfinite(dx) || !isfinite(dy)) {
+    return;
+  }
 
-      // Interpolate normal for this vertex
-      Vector *N = interpolate_normal(&coords, T);
+  // Clip the segment against the window (Liang-Barsky),
+  //    so that far away vertices don't produce
+  //    arbitrarily long lines
+  double t0 = 0.0, t1 = 1.0;
+  double p[4] = {-dx, dx, -dy, dy};
+  double q[4] = {x0, ctx->w - 1 - x0, y0, ctx->h - 1 - y0};
+  for (int k = 0; k < 4; k++) {
+    if (p[k] == 0.0) {
+      if (q[k] < 0.0) {
+        return;
+      }
+    } else {
+      double t = q[k] / p[k];
+      if (p[k] < 0.0) {
+        t0 = fmax(t0, t);
+      } else {
+        t1 = fmin(t1, t);
+      }
+    }
+  }
 
-      // Paint interior pixel usint the Phong's model
-      //  of reflection and color
-      pixels[i][j] = color_from_point(camera_space, N, light);
+  if (t0 > t1) {
+    return;
+  }
 
-      // Cleanup
-      destroy_vector(N);
+  // Bresenham between the clipped endpoints,
+  //    with depth linearly interpolated
+  int xa = (int)floor(x0 + t0 * dx), ya = (int)floor(y0 + t0 * dy);
+  int xb = (int)floor(x0 + t1 * dx), yb = (int)floor(y0 + t1 * dy);
+  Scalar z0 = za + t0 * (zb - za), z1 = za + t1 * (zb - za);
+  int sx = (xa < xb) ? 1 : -1, sy = (ya < yb) ? 1 : -1;
+  int ex = abs(xb - xa), ey = -abs(yb - ya);
+  int n = (ex > -ey) ? ex : -ey;
+  Scalar dz = (n > 0) ? (z1 - z0) / n : 0.0;
+  int err = ex + ey;
+  Scalar z = z0;
+  for (int k = 0; k <= n; k++) {
+    plot(ya, xa, z, color, ctx);
+    int e2 = 2 * err;
+    if (e2 >= ey) {
+      err += ey;
+      xa += sx;
     }
+    if (e2 <= ex) {
+      err += ex;
+      ya += sy;
+    }
+    z += dz;
   }
+}
 
-  // Cleanup
-  destroy_vector(P);
-  destroy_vector(camera_space);
+void rasterize_edges(RenderTriangles *T, int t, RasterContext *ctx) {
+  Color color = unshaded_color(ctx->material);
+  Scalar(*window)[2] = T->window + 3 * t;
+  Scalar(*camera)[3] = T->camera + 3 * t;
+  for (int k = 0; k < 3; k++) {
+    int l = (k + 1) % 3;
+    draw_line(window[k], window[l], camera[k][2], camera[l][2], color, ctx);
+  }
 }
 
-void rasterize_from_bottom(RenderTriangle *T, Color **pixels, double **zbuffer,
-                           int w, int h, Light *light) {
-  //   v1 ------ v2
-  //     \       /
-  //      \     /
-  //       \   /
-  //        \ /
-  //         v3
+void submit_points(Instance *instance, SpaceConverter *cvt,
+                   RasterContext *ctx, PrimitiveList *list) {
+  Object *mesh = instance->mesh;
+
+  // Each vertex of the mesh is transformed only
+  //    once (in parallel), then the visible ones
+  //    are submitted in order
+  begin_stage(ctx->stats, STAGE_TRANSFORM);
+  StageJob job = {ctx, instance, cvt};
+  job.points = (Primitive *)malloc(mesh->n_vertices * sizeof(Primitive));
+  job.boxes = (BoundingBox *)malloc(mesh->n_vertices * sizeof(BoundingBox));
+  job.visible = (bool *)malloc(mesh->n_vertices * sizeof(bool));
+  parallel_for(ctx->options->scheduler, count_tasks(mesh->n_vertices),
+               transform_points, &job);
+
+  for (int v = 0; v < mesh->n_vertices; v++) {
+    if (job.visible[v]) {
+      append_primitive(list, job.points[v], job.boxes[v]);
+    }
+  }
+  free(job.points);
+  free(job.boxes);
+  free(job.visible);
+  end_stage(ctx->stats, STAGE_TRANSFORM);
+
+  if (ctx->stats != NULL) {
+    ctx->stats->triangles_in += mesh->n_triangles;
+  }
+}
 
-  // Guarantee that v1.x <= v2.x
-  sort_vertices_by_window_horizontal_line(T, true);
+void transform_points(void *data, int task, int worker) {
+  StageJob *job = (StageJob *)data;
+  RasterContext *ctx = job->ctx;
+  Object *mesh = job->instance->mesh;
+  int first, last;
+  task_range(task, mesh->n_vertices, &first, &last);
 
-  // Obtaining inverse slopes
-  double slope_v13 = get_slope(T->window[0], T->window[2]);
-  double slope_v23 = get_slope(T->window[1], T->window[2]);
-  double inv_v13 = (fabs(slope_v13) <= 0.01) ? 0.0 : 1.0 / slope_v13;
-  double inv_v23 = (fabs(slope_v23) <= 0.01) ? 0.0 : 1.0 / slope_v23;
+  for (int v = first; v < last; v++) {
+    Scalar camera[3], window[2];
+    transform_vertex(job->instance, job->cvt, ctx->w, ctx->h, v, camera,
+                     window);
 
-  // Starting lx and rx in the same spot
-  double lx = *T->window[2]->x;
-  double rx = lx;
+    // Vertices behind the camera aren't visible, and
+    //    the ones just in front of it are clamped to
+    //    the guard band, so that they fit an int
+    double x = window[0], y = window[1];
+    job->visible[v] = camera[2] > 0 && isfinite(x) && isfinite(y);
+    if (job->visible[v]) {
+      x = fmax(-GUARD_BAND, fmin(GUARD_BAND, x));
+      y = fmax(-GUARD_BAND, fmin(GUARD_BAND, y));
+      Primitive point = {NULL, 0, NULL, ctx->material, x, y, camera[2]};
+      int j0 = (int)floor(x) - POINT_SPLAT_SIZE / 2;
+      int i0 = (int)floor(y) - POINT_SPLAT_SIZE / 2;
+      BoundingBox box = {(j0 < 0) ? 0 : j0, (i0 < 0) ? 0 : i0,
+                         j0 + POINT_SPLAT_SIZE - 1, i0 + POINT_SPLAT_SIZE - 1};
+      box.max_x = (box.max_x >= ctx->w) ? ctx->w - 1 : box.max_x;
+      box.max_y = (box.max_y >= ctx->h) ? ctx->h - 1 : box.max_y;
+      job->points[v] = point;
+      job->boxes[v] = box;
+    }
+  }
+}
 
-  for (double y = *T->window[2]->y; y >= *T->window[0]->y; y--) {
-    // Scan line by line
-    for (double x = lx; x <= rx; x++) {
-      paint(x, y, T, pixels, zbuffer, w, h, light);
+void splat_point(Primitive *point, RasterContext *ctx) {
+  Color color = unshaded_color(point->material);
+  int j0 = (int)floor(point->x) - POINT_SPLAT_SIZE / 2;
+  int i0 = (int)floor(point->y) - POINT_SPLAT_SIZE / 2;
+  for (int i = i0; i < i0 + POINT_SPLAT_SIZE; i++) {
+    for (int j = j0; j < j0 + POINT_SPLAT_SIZE; j++) {
+      plot(i, j, point->z, color, ctx);
     }
+  }
+}
+
+bool is_cancelled(RasterContext *ctx) {
+  // Once cancelled, the callback isn't polled anymore
+  if (!ctx->cancelled && ctx->options->cancel != NULL) {
+    ctx->cancelled = ctx->options->cancel(ctx->options->cancel_data);
+  }
+
+  return ctx->cancelled;
+}
+
+void create_sample_buffers(RasterContext *ctx) {
+  switch (ctx->samples) {
+  case 1:
+    // Single sample per pixel, the tile
+    //    depth and color buffers are used directly
+    ctx->positions = SAMPLES_1X;
+    return;
+  case 2:
+    ctx->positions = SAMPLES_2X;
+    break;
+  case 4:
+    ctx->positions = SAMPLES_4X;
+    break;
+  case 8:
+    ctx->positions = SAMPLES_8X;
+    break;
+  default:
+    assert(false && "unsupported number of samples");
+  }
+
+  // Samples of a single tile, cleared
+  //    before rasterizing it
+  int n = BIN_TILE_SIZE * BIN_TILE_SIZE * ctx->samples;
+  ctx->sample_depth = (Scalar *)malloc(n * sizeof(Scalar));
+  ctx->sample_colors = (Color *)malloc(n * sizeof(Color));
+  assert(ctx->sample_depth != NULL && ctx->sample_colors != NULL);
+}
+
+EdgeEquation edge_equation(Scalar *A, Scalar *B) {
+  EdgeEquation edge = {A[0], A[1], B[0] - A[0], B[1] - A[1]};
+  return edge;
+}
+
+double evaluate_edge(EdgeEquation *edge, double x, double y) {
+  // Twice the signed area of the triangle (A, B, P)
+  return edge->dx * (y - edge->y0) - edge->dy * (x - edge->x0);
+}
 
-    lx -= inv_v13;
-    rx -= inv_v23;
+void resolve_samples(RasterContext *ctx) {
+  if (ctx->samples == 1) {
+    return;
+  }
+
+  for (int i = ctx->y0; i < ctx->y1; i++) {
+    for (int j = ctx->x0; j < ctx->x1; j++) {
+      int pixel = (i - ctx->y0) * BIN_TILE_SIZE + (j - ctx->x0);
+      Color *colors = ctx->sample_colors + pixel * ctx->samples;
+      int r = 0, g = 0, b = 0;
+      for (int s = 0; s < ctx->samples; s++) {
+        r += colors[s].r;
+        g += colors[s].g;
+        b += colors[s].b;
+      }
+
+      // Rounded average of the samples
+      int half = ctx->samples / 2;
+      Color c = {(r + half) / ctx->samples, (g + half) / ctx->samples,
+                 (b + half) / ctx->samples, 255};
+      ctx->colors[pixel] = c;
+    }
   }
 }
 
-void rasterize_from_top(RenderTriangle *T, Color **pixels, double **zbuffer,
-                        int w, int h, Light *light) {
-  //         v1
-  //        / \
-  //       /   \
-  //      /     \
-  //     /       \
-  //    v2 ----- v3
+void rasterize_occlusion_culled(Scene *scene, RasterContext *ctx,
+                                StageJob *job, Submission *submissions,
+                                bool **kept) {
+  OcclusionCulling *occlusion = ctx->options->occlusion;
+  FrameStats *stats = ctx->stats;
+  int n = scene->n_instances;
 
-  // Guarantee that v2.x <= v3.x
-  sort_vertices_by_window_horizontal_line(T, false);
+  // Project the clusters of every instance, where
+  //    the ones drawn in the last frame (and still
+  //    inside the window) are drawn first
+  begin_stage(stats, STAGE_SETUP);
+  InstanceClusters **clusters =
+      (InstanceClusters **)malloc(n * sizeof(InstanceClusters *));
+  ClusterView **views = (ClusterView **)malloc(n * sizeof(ClusterView *));
+  assert(clusters != NULL && views != NULL);
 
-  // Obtaining inverse slopes
-  double slope_v12 = get_slope(T->window[0], T->window[1]);
-  double slope_v13 = get_slope(T->window[0], T->window[2]);
-  double inv_v12 = (fabs(slope_v12) <= 0.01) ? 0.0 : 1.0 / slope_v12;
-  double inv_v13 = (fabs(slope_v13) <= 0.01) ? 0.0 : 1.0 / slope_v13;
+  // Vertices of each instance, transformed once for
+  //    both passes (and only if any triangle is drawn)
+  InstanceVertices **vertices =
+      (InstanceVertices **)calloc(n, sizeof(InstanceVertices *));
+  assert(vertices != NULL);
+  for (int i = 0; i < n; i++) {
+    Instance *instance = scene->instances + i;
+    clusters[i] = instance_clusters(occlusion, i, instance);
+    views[i] =
+        (ClusterView *)malloc(clusters[i]->n_clusters * sizeof(ClusterView));
+    assert(views[i] != NULL);
+    for (int c = 0; c < clusters[i]->n_clusters; c++) {
+      ClusterView *view = views[i] + c;
+      view->inside =
+          project_cluster(clusters[i]->clusters + c, instance, scene->cvt,
+                          ctx->w, ctx->h, &view->box, &view->min_z);
+      view->pass = (view->inside && clusters[i]->visible[c]) ? 1 : 0;
+      if (stats != NULL) {
+        stats->clusters_tested++;
+        stats->clusters_culled += !view->inside;
+      }
+    }
+  }
+  end_stage(stats, STAGE_SETUP);
 
-  // Start lx and rx at the same spot
-  double lx = *T->window[0]->x;
-  double rx = lx;
+  // First pass, whose depth builds the pyramid
+  for (int i = 0; i < n && !is_cancelled(ctx); i++) {
+    submit_clusters(scene->instances + i, scene->cvt, vertices + i,
+                    clusters[i], views[i], 1, (kept != NULL) ? kept[i] : NULL,
+                    ctx, job->list, submissions + i);
+  }
+  int n_tiles = ((ctx->w + BIN_TILE_SIZE - 1) / BIN_TILE_SIZE) *
+                ((ctx->h + BIN_TILE_SIZE - 1) / BIN_TILE_SIZE);
+  job->saved = (SavedTile *)calloc(n_tiles, sizeof(SavedTile));
+  assert(job->saved != NULL);
+  job->pyramid = create_depth_pyramid(ctx->w, ctx->h);
+  job->pass = 1;
+  rasterize_tiles(ctx, job, -1);
+  build_depth_pyramid(job->pyramid);
+
+  // Second pass: the remaining clusters that aren't
+  //    hidden by the first one, which are drawn on top
+  //    of the saved tiles of the first pass
+  begin_stage(stats, STAGE_SETUP);
+  for (int i = 0; i < n; i++) {
+    for (int c = 0; c < clusters[i]->n_clusters; c++) {
+      ClusterView *view = views[i] + c;
+      if (!view->inside || view->pass != 0) {
+        continue;
+      }
+
+      bool occluded = is_occluded(job->pyramid, &view->box, view->min_z);
+      view->pass = occluded ? 0 : 2;
+      if (stats != NULL) {
+        stats->clusters_occluded += occluded;
+      }
+    }
+  }
+  end_stage(stats, STAGE_SETUP);
+
+  int first_new = job->list->n;
+  for (int i = 0; i < n && !is_cancelled(ctx); i++) {
+    submit_clusters(scene->instances + i, scene->cvt, vertices + i,
+                    clusters[i], views[i], 2, (kept != NULL) ? kept[i] : NULL,
+                    ctx, job->list, submissions + n + i);
+  }
+  if (job->list->n > first_new) {
+    job->pass = 2;
+    rasterize_tiles(ctx, job, first_new);
+    build_depth_pyramid(job->pyramid);
+  }
+
+  // The clusters drawn in this frame that are visible
+  //    in its final depth are drawn first in the next
+  //    one (unless the frame was abandoned)
+  for (int i = 0; i < n && !is_cancelled(ctx); i++) {
+    for (int c = 0; c < clusters[i]->n_clusters; c++) {
+      ClusterView *view = views[i] + c;
+      clusters[i]->visible[c] =
+          view->pass != 0 &&
+          !is_occluded(job->pyramid, &view->box, view->min_z);
+    }
+  }
 
-  for (double y = *T->window[0]->y; y <= *T->window[1]->y; y++) {
-    // Scan line by line
-    for (double x = lx; x <= rx; x++) {
-      paint(x, y, T, pixels, zbuffer, w, h, light);
+  // Cleanup
+  for (int i = 0; i < n; i++) {
+    free(views[i]);
+    if (vertices[i] != NULL) {
+      destroy_instance_vertices(vertices[i]);
     }
+  }
+  for (int t = 0; t < n_tiles; t++) {
+    free(job->saved[t].depth);
+    free(job->saved[t].colors);
+  }
+  free(job->saved);
+  job->saved = NULL;
+  free(views);
+  free(vertices);
+  free(clusters);
+  destroy_depth_pyramid(job->pyramid);
+  job->pyramid = NULL;
+}
 
-    lx += inv_v12;
-    rx += inv_v13;
+void submit_clusters(Instance *instance, SpaceConverter *cvt,
+                     InstanceVertices **vertices, InstanceClusters *clusters,
+                     ClusterView *views, int pass, bool *kept,
+                     RasterContext *ctx, PrimitiveList *list,
+                     Submission *submission) {
+  int n_triangles = 0;
+  for (int c = 0; c < clusters->n_clusters; c++) {
+    n_triangles += (views[c].pass == pass) ? clusters->clusters[c].count : 0;
+  }
+  if (n_triangles == 0) {
+    return;
   }
+
+  // Triangles are submitted in the order of the mesh,
+  //    as they would be without culling, except for
+  //    the ones of culled meshlets
+  submission->subset = (int *)malloc(n_triangles * sizeof(int));
+  assert(submission->subset != NULL);
+  submission->n_triangles = 0;
+  for (int c = 0; c < clusters->n_clusters; c++) {
+    Cluster *cluster = clusters->clusters + c;
+    for (int i = 0; i < cluster->count && views[c].pass == pass; i++) {
+      int t = clusters->order[cluster->first + i];
+      if (kept == NULL || kept[t]) {
+        submission->subset[submission->n_triangles++] = t;
+      }
+    }
+  }
+  if (submission->n_triangles == 0) {
+    free(submission->subset);
+    submission->subset = NULL;
+    return;
+  }
+  qsort(submission->subset, submission->n_triangles, sizeof(int),
+        compare_triangle_indices);
+
+  submit_instance(instance, cvt, vertices, ctx, list, submission);
 }
 
-double **create_zbuffer(int width, int height) {
-  double **zbuffer = (double **)malloc(height * sizeof(double *));
-  for (int i = 0; i < height; i++) {
-    zbuffer[i] = (double *)malloc(width * sizeof(double));
-    for (int j = 0; j < width; j++) {
-      // Initially, the z-buffer start with
-      //    positive infinity
-      zbuffer[i][j] = INFINITY;
+int compare_triangle_indices(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+bool **cull_scene_meshlets(Scene *scene, RasterContext *ctx) {
+  FrameStats *stats = ctx->stats;
+  bool backfaces = ctx->options->mode == RENDER_SHADED;
+  begin_stage(stats, STAGE_SETUP);
+  bool **kept = (bool **)malloc(scene->n_instances * sizeof(bool *));
+  assert(kept != NULL);
+  for (int i = 0; i < scene->n_instances; i++) {
+    Instance *instance = scene->instances + i;
+    kept[i] = (bool *)malloc(instance->mesh->n_triangles * sizeof(bool));
+    assert(kept[i] != NULL || instance->mesh->n_triangles == 0);
+    int culled = cull_meshlets(instance, scene->cvt, ctx->w, ctx->h,
+                               backfaces, kept[i]);
+    if (stats != NULL) {
+      stats->meshlets_tested += instance->mesh->n_meshlets;
+      stats->meshlets_culled += culled;
     }
   }
+  end_stage(stats, STAGE_SETUP);
 
-  return zbuffer;
+  return kept;
 }
 
-void destroy_zbuffer(double **zbuffer, int width, int height) {
-  // Fre sub-arrays
-  for (int i = 0; i < height; i++) {
-    free(zbuffer[i]);
+bool select_kept_triangles(Object *mesh, bool *kept, Submission *submission) {
+  int n_kept = 0;
+  for (int t = 0; t < mesh->n_triangles && kept != NULL; t++) {
+    n_kept += kept[t];
   }
 
-  // Free pointer
-  free(zbuffer);
+  // Without culled triangles, the whole mesh
+  //    is submitted
+  if (kept == NULL || n_kept == mesh->n_triangles) {
+    submission->n_triangles = mesh->n_triangles;
+    return true;
+  } else if (n_kept == 0) {
+    // Nothing to submit
+    return false;
+  }
+
+  submission->subset = (int *)malloc(n_kept * sizeof(int));
+  assert(submission->subset != NULL);
+  submission->n_triangles = 0;
+  for (int t = 0; t < mesh->n_triangles; t++) {
+    if (kept[t]) {
+      submission->subset[submission->n_triangles++] = t;
+    }
+  }
+
+  return true;
 }
 
 void destroy_canvas(Color **canvas, int width, int height) {
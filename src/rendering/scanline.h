@@ -2,10 +2,99 @@
 #define SCANFILL
 
 #include "../core/scene.h"
+#include "occlusion.h"
+#include "scheduler.h"
+#include "stats.h"
+#include <stdbool.h>
 
-// Main rasterization function
-Color **rasterize(Object *world_object, Light *light, SpaceConverter *cvt,
-                  int width, int height);
+// Maximum number of samples per pixel
+#define MAX_SAMPLES 8
+
+// Shaded rendering and unshaded preview modes, which
+//    skip vertex normals and the Phong's model
+typedef enum { RENDER_SHADED, RENDER_WIREFRAME, RENDER_POINTS } RenderMode;
+
+// Shading quality: Phong's model evaluated per pixel or
+//    per vertex, with colors interpolated (Gouraud)
+typedef enum { SHADING_PHONG, SHADING_GOURAUD } ShadingModel;
+
+typedef struct {
+  // Samples per pixel (1, 2, 4 or 8). With more than
+  //    one sample, coverage and depth are evaluated
+  //    per sample, while shading runs once per pixel
+  //    covered by a triangle
+  int samples;
+
+  // Optional cancellation callback, polled during
+  //    rasterization. Once it returns true, the frame
+  //    is abandoned
+  bool (*cancel)(void *data);
+  void *cancel_data;
+
+  // Wireframe draws the edges of every triangle (with
+  //    depth test), while points splats each vertex of
+  //    the mesh. Both ignore multisampling
+  RenderMode mode;
+
+  // Shading quality of the shaded mode
+  ShadingModel shading;
+
+  // Optional scheduler that runs the parallel stages
+  //    (transform, normals, setup, raster and shade).
+  //    If NULL, the frame is rendered serially
+  TaskScheduler *scheduler;
+
+  // Optional packed output, where the frame is
+  //    written as 8-bit RGBA (4 * width bytes per row,
+  //    top to bottom) instead of a canvas. Each tile is
+  //    packed by the worker that rendered it, right
+  //    after it's done
+  uint8_t *target;
+
+  // Optional cluster occlusion culling, whose state is
+  //    kept by the caller across frames (see occlusion.h).
+  //    Clusters drawn in the last frame are drawn first,
+  //    then the others are tested against the depth they
+  //    produced and only the visible ones are drawn.
+  //    Both passes share the vertices of each instance,
+  //    so shading is the same as without culling.
+  //    Ignored in points mode
+  OcclusionCulling *occlusion;
+
+  // Meshlet culling: triangles of the meshlets (see
+  //    meshlets.h) outside the view frustum are skipped
+  //    before their setup and, in shaded mode, so are
+  //    the ones of closed meshes facing away from the
+  //    camera (open meshes keep their back faces).
+  //    Vertex normals still take the whole mesh into
+  //    account, so shading doesn't change at the
+  //    silhouettes. Ignored in points mode
+  bool cull_meshlets;
+} RenderOptions;
+
+RenderOptions default_render_options();
+
+/*
+ * Name of each render mode ("shaded", "wireframe" or
+ * "points") and its inverse, which returns false if the
+ * name isn't known.
+ * */
+const char *render_mode_name(RenderMode mode);
+bool parse_render_mode(const char *name, RenderMode *mode);
+
+// Same for the shading models ("phong" or "gouraud")
+const char *shading_model_name(ShadingModel shading);
+bool parse_shading_model(const char *name, ShadingModel *shading);
+
+/*
+ * Main rasterization function. If options is NULL,
+ * the default options are used. If stats isn't NULL,
+ * the time spent in each stage and the pipeline counters
+ * are added to it. Returns NULL if the frame was
+ * cancelled or only packed into options->target.
+ * */
+Color **rasterize(Scene *scene, int width, int height,
+                  RenderOptions *options, FrameStats *stats);
 
 // Cleanup
 void destroy_canvas(Color **canvas, int width, int height);
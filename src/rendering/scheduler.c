@@ -0,0 +1,267 @@
+#include "scheduler.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Size (in bytes) of a cache line, deques are
+//    padded to avoid false sharing
+#define CACHE_LINE_SIZE 64
+
+// Tasks of a loop are indices, so a deque only holds
+//    the range [top, bottom). The owner pops from the
+//    bottom, while the other workers steal from the top
+typedef struct {
+  atomic_int top, bottom;
+  char padding[CACHE_LINE_SIZE - 2 * sizeof(atomic_int)];
+} WorkDeque;
+
+typedef struct {
+  TaskScheduler *scheduler;
+  int id;
+} Worker;
+
+struct TaskScheduler {
+  int n_workers;
+  pthread_t *threads;
+  Worker *workers;
+  WorkDeque *deques;
+
+  // Current loop
+  TaskFunction function;
+  void *data;
+
+  // Loops are numbered, so that sleeping workers
+  //    know when a new one starts. Running counts
+  //    the workers (besides the caller) still busy
+  pthread_mutex_t lock;
+  pthread_cond_t start, done;
+  long generation;
+  int running;
+  bool stop;
+};
+
+// Deque operations
+bool pop_task(WorkDeque *deque, int *task);
+bool steal_task(WorkDeque *deque, int *task);
+
+// Workers
+void run_tasks(TaskScheduler *scheduler, int id);
+void *worker_main(void *data);
+
+TaskScheduler *create_scheduler(int n_workers) {
+  TaskScheduler *scheduler = (TaskScheduler *)malloc(sizeof(TaskScheduler));
+  assert(scheduler != NULL);
+  scheduler->n_workers = (n_workers > 0) ? n_workers : available_cores();
+  scheduler->generation = 0;
+  scheduler->running = 0;
+  scheduler->stop = false;
+  pthread_mutex_init(&scheduler->lock, NULL);
+  pthread_cond_init(&scheduler->start, NULL);
+  pthread_cond_init(&scheduler->done, NULL);
+
+  int n = scheduler->n_workers;
+  scheduler->deques = (WorkDeque *)calloc(n, sizeof(WorkDeque));
+  scheduler->workers = (Worker *)malloc(n * sizeof(Worker));
+  scheduler->threads = (pthread_t *)malloc(n * sizeof(pthread_t));
+  assert(scheduler->deques != NULL && scheduler->workers != NULL &&
+         scheduler->threads != NULL);
+
+  // The calling thread is the worker 0. If a thread
+  //    can't be started (e.g., a limit on the number
+  //    of threads), the loops run on the previous ones
+  for (int i = 0; i < n; i++) {
+    scheduler->workers[i].scheduler = scheduler;
+    scheduler->workers[i].id = i;
+    if (i > 0 && pthread_create(scheduler->threads + i, NULL, worker_main,
+                                scheduler->workers + i) != 0) {
+      scheduler->n_workers = i;
+      break;
+    }
+  }
+
+  return scheduler;
+}
+
+void parallel_for(TaskScheduler *scheduler, int n_tasks, TaskFunction function,
+                  void *data) {
+  // Serial fallback
+  if (scheduler == NULL || scheduler->n_workers == 1 || n_tasks <= 1) {
+    for (int i = 0; i < n_tasks; i++) {
+      function(data, i, 0);
+    }
+    return;
+  }
+
+  // Evenly distribute the tasks among the deques,
+  //    uneven work is balanced by stealing
+  int n = scheduler->n_workers;
+  for (int i = 0; i < n; i++) {
+    int first = (int)((long)i * n_tasks / n);
+    int last = (int)((long)(i + 1) * n_tasks / n);
+    atomic_store(&scheduler->deques[i].top, first);
+    atomic_store(&scheduler->deques[i].bottom, last);
+  }
+
+  // Wake up the workers
+  pthread_mutex_lock(&scheduler->lock);
+  scheduler->function = function;
+  scheduler->data = data;
+  scheduler->generation++;
+  scheduler->running = n - 1;
+  pthread_cond_broadcast(&scheduler->start);
+  pthread_mutex_unlock(&scheduler->lock);
+
+  run_tasks(scheduler, 0);
+
+  // Wait until every worker leaves the loop, so
+  //    that the deques can be reused
+  pthread_mutex_lock(&scheduler->lock);
+  while (scheduler->running > 0) {
+    pthread_cond_wait(&scheduler->done, &scheduler->lock);
+  }
+  pthread_mutex_unlock(&scheduler->lock);
+}
+
+void run_tasks(TaskScheduler *scheduler, int id) {
+  int n = scheduler->n_workers;
+  int task;
+  while (true) {
+    // First, the worker's own tasks
+    bool found = pop_task(scheduler->deques + id, &task);
+
+    // Then, steal from the others, starting
+    //    from the next worker
+    for (int k = 1; k < n && !found; k++) {
+      found = steal_task(scheduler->deques + (id + k) % n, &task);
+    }
+
+    // Tasks don't spawn new tasks, so once every
+    //    deque is empty the loop is done
+    if (!found) {
+      return;
+    }
+
+    scheduler->function(scheduler->data, task, id);
+  }
+}
+
+void *worker_main(void *data) {
+  Worker *worker = (Worker *)data;
+  TaskScheduler *scheduler = worker->scheduler;
+  long seen = 0;
+
+  pthread_mutex_lock(&scheduler->lock);
+  while (true) {
+    // Sleep until a new loop starts
+    while (!scheduler->stop && scheduler->generation == seen) {
+      pthread_cond_wait(&scheduler->start, &scheduler->lock);
+    }
+
+    if (scheduler->stop) {
+      break;
+    }
+
+    seen = scheduler->generation;
+    pthread_mutex_unlock(&scheduler->lock);
+    run_tasks(scheduler, worker->id);
+    pthread_mutex_lock(&scheduler->lock);
+
+    if (--scheduler->running == 0) {
+      pthread_cond_signal(&scheduler->done);
+    }
+  }
+  pthread_mutex_unlock(&scheduler->lock);
+
+  return NULL;
+}
+
+bool pop_task(WorkDeque *deque, int *task) {
+  // Reserve the bottom task before looking at
+  //    the top (Chase-Lev deque)
+  int bottom = atomic_load(&deque->bottom) - 1;
+  atomic_store(&deque->bottom, bottom);
+  int top = atomic_load(&deque->top);
+
+  if (top > bottom) {
+    // Empty
+    atomic_store(&deque->bottom, bottom + 1);
+    return false;
+  }
+
+  *task = bottom;
+  if (top < bottom) {
+    return true;
+  }
+
+  // Last task, thieves might be trying to take it
+  bool won = atomic_compare_exchange_strong(&deque->top, &top, top + 1);
+  atomic_store(&deque->bottom, bottom + 1);
+  return won;
+}
+
+bool steal_task(WorkDeque *deque, int *task) {
+  int top = atomic_load(&deque->top);
+  int bottom = atomic_load(&deque->bottom);
+  while (top < bottom) {
+    // On failure, top is updated and another
+    //    attempt is made while tasks remain
+    if (atomic_compare_exchange_weak(&deque->top, &top, top + 1)) {
+      *task = top;
+      return true;
+    }
+    bottom = atomic_load(&deque->bottom);
+  }
+
+  return false;
+}
+
+int count_tasks(int n) {
+  return (n + ITEMS_PER_TASK - 1) / ITEMS_PER_TASK;
+}
+
+void task_range(int task, int n, int *first, int *last) {
+  *first = task * ITEMS_PER_TASK;
+  *last = (*first + ITEMS_PER_TASK < n) ? *first + ITEMS_PER_TASK : n;
+}
+
+int scheduler_workers(TaskScheduler *scheduler) {
+  return (scheduler == NULL) ? 1 : scheduler->n_workers;
+}
+
+int available_cores() {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  int n = (int)info.dwNumberOfProcessors;
+#else
+  int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return (n > 0) ? n : 1;
+}
+
+void destroy_scheduler(TaskScheduler *scheduler) {
+  // Wake up and join every worker
+  pthread_mutex_lock(&scheduler->lock);
+  scheduler->stop = true;
+  pthread_cond_broadcast(&scheduler->start);
+  pthread_mutex_unlock(&scheduler->lock);
+  for (int i = 1; i < scheduler->n_workers; i++) {
+    pthread_join(scheduler->threads[i], NULL);
+  }
+
+  // Cleanup
+  pthread_mutex_destroy(&scheduler->lock);
+  pthread_cond_destroy(&scheduler->start);
+  pthread_cond_destroy(&scheduler->done);
+  free(scheduler->deques);
+  free(scheduler->workers);
+  free(scheduler->threads);
+  free(scheduler);
+}
@@ -0,0 +1,62 @@
+#ifndef RENDERING_SCHEDULER
+#define RENDERING_SCHEDULER
+
+/*
+ * Work-stealing scheduler shared by the parallel stages
+ * of the pipeline. A parallel loop is split into tasks
+ * (e.g., chunks of triangles or screen tiles), which are
+ * evenly distributed among the deques of the workers.
+ * Each worker pops tasks from the bottom of its own deque
+ * and, once it's empty, steals from the top of the others
+ * (without locks), so that uneven work is balanced.
+ * */
+typedef struct TaskScheduler TaskScheduler;
+
+// Number of items (e.g., triangles or vertices)
+//    processed by each task of a loop over items
+#define ITEMS_PER_TASK 256
+
+// Body of a parallel loop. It receives the loop data,
+//    the index of the task and the index of the worker
+//    running it (in [0, scheduler_workers(scheduler)))
+typedef void (*TaskFunction)(void *data, int task, int worker);
+
+/*
+ * Start a scheduler with n_workers workers, where the
+ * calling thread is the first one. If n_workers is not
+ * positive, one worker per available core is used, while
+ * a single worker runs every task serially (no thread is
+ * started). If a thread can't be started, the scheduler
+ * keeps the workers started before it (see
+ * scheduler_workers).
+ * */
+TaskScheduler *create_scheduler(int n_workers);
+
+/*
+ * Run the tasks [0, n_tasks) and wait for all of them.
+ * The scheduler can be NULL, in which case tasks run
+ * serially in the calling thread. A scheduler runs a
+ * single loop at a time, so it shouldn't be shared by
+ * threads rendering concurrently.
+ * */
+void parallel_for(TaskScheduler *scheduler, int n_tasks, TaskFunction function,
+                  void *data);
+
+/*
+ * Loops over n items are split in chunks of ITEMS_PER_TASK
+ * consecutive items, one per task: count_tasks is the
+ * number of tasks and task_range the items [first, last)
+ * of a task.
+ * */
+int count_tasks(int n);
+void task_range(int task, int n, int *first, int *last);
+
+// Number of workers (1 if the scheduler is NULL)
+int scheduler_workers(TaskScheduler *scheduler);
+
+// Number of cores available to the process
+int available_cores();
+
+void destroy_scheduler(TaskScheduler *scheduler);
+
+#endif
@@ -0,0 +1,147 @@
+#include "stats.h"
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+bool should_call_hook(FrameStats *stats, Stage stage) {
+  return stats->hook != NULL && (stats->hook_stages & (1u << stage));
+}
+
+double now_seconds() {
+#ifdef _WIN32
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+void reset_stats(FrameStats *stats) {
+  if (stats == NULL) {
+    return;
+  }
+
+  FrameStats previous = *stats;
+  memset(stats, 0, sizeof(FrameStats));
+  stats->frame = previous.frame + 1;
+  stats->hook = previous.hook;
+  stats->hook_data = previous.hook_data;
+  stats->hook_stages = previous.hook_stages;
+}
+
+void begin_stage(FrameStats *stats, Stage stage) {
+  if (stats == NULL) {
+    return;
+  }
+  assert(stats->depth < MAX_STAGE_DEPTH);
+
+  // Pause the current stage, if any
+  double now = now_seconds();
+  Stage current = N_STAGES;
+  if (stats->depth > 0) {
+    current = stats->active[stats->depth - 1];
+    stats->time[current] += now - stats->last;
+  }
+
+  stats->active[stats->depth++] = stage;
+  if (should_call_hook(stats, stage)) {
+    stats->hook(stats->hook_data, current);
+    now = now_seconds();
+  }
+  stats->last = now;
+}
+
+void end_stage(FrameStats *stats, Stage stage) {
+  if (stats == NULL) {
+    return;
+  }
+  assert(stats->depth > 0 && stats->active[stats->depth - 1] == stage);
+
+  // Resume the parent stage, if any
+  double now = now_seconds();
+  stats->time[stage] += now - stats->last;
+  stats->depth--;
+  if (should_call_hook(stats, stage)) {
+    stats->hook(stats->hook_data, stage);
+    now = now_seconds();
+  }
+  stats->last = now;
+}
+
+void merge_worker_stats(FrameStats *stats, FrameStats *workers, int n,
+                        Stage stage, double wall) {
+  if (stats == NULL) {
+    return;
+  }
+
+  double busy[N_STAGES] = {0.0};
+  double total = 0.0;
+  for (int w = 0; w < n; w++) {
+    FrameStats *worker = workers + w;
+    stats->triangles_in += worker->triangles_in;
+    stats->triangles_culled += worker->triangles_culled;
+    stats->triangles_degenerate += worker->triangles_degenerate;
+    stats->fragments_tested += worker->fragments_tested;
+    stats->fragments_passed += worker->fragments_passed;
+    stats->pixels_shaded += worker->pixels_shaded;
+    for (int i = 0; i < N_STAGES; i++) {
+      busy[i] += worker->time[i];
+      total += worker->time[i];
+    }
+  }
+
+  // Move the share of the other stages out
+  //    of the parallel stage
+  for (int i = 0; i < N_STAGES && total > 0.0; i++) {
+    if (i != stage) {
+      double share = wall * busy[i] / total;
+      stats->time[i] += share;
+      stats->time[stage] -= share;
+    }
+  }
+}
+
+const char *stage_name(Stage stage) {
+  static const char *names[N_STAGES] = {
+      "load", "transform", "normals", "setup", "raster", "shade", "present"};
+  assert(stage >= 0 && stage < N_STAGES);
+  return names[stage];
+}
+
+double total_time(FrameStats *stats) {
+  double total = 0.0;
+  for (int i = 0; i < N_STAGES; i++) {
+    total += stats->time[i];
+  }
+  return total;
+}
+
+void write_stats_json(FrameStats *stats, FILE *fp) {
+  fprintf(fp, "{\"frame\": %d, \"width\": %d, \"height\": %d, \"time_s\": {",
+          stats->frame, stats->width, stats->height);
+  for (int i = 0; i < N_STAGES; i++) {
+    fprintf(fp, "\"%s\": %.6f, ", stage_name(i), stats->time[i]);
+  }
+  fprintf(fp, "\"total\": %.6f}, ", total_time(stats));
+  fprintf(fp,
+          "\"triangles_in\": %ld, \"triangles_culled\": %ld, "
+          "\"triangles_degenerate\": %ld, \"fragments_tested\": %ld, "
+          "\"fragments_passed\": %ld, \"pixels_shaded\": %ld, "
+          "\"clusters_tested\": %ld, \"clusters_culled\": %ld, "
+          "\"clusters_occluded\": %ld, \"meshlets_tested\": %ld, "
+          "\"meshlets_culled\": %ld}\n",
+          stats->triangles_in, stats->triangles_culled,
+          stats->triangles_degenerate, stats->fragments_tested,
+          stats->fragments_passed, stats->pixels_shaded,
+          stats->clusters_tested, stats->clusters_culled,
+          stats->clusters_occluded, stats->meshlets_tested,
+          stats->meshlets_culled);
+  fflush(fp);
+}
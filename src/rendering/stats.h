@@ -0,0 +1,93 @@
+#ifndef RENDERING_STATS
+#define RENDERING_STATS
+#include <stdbool.h>
+#include <stdio.h>
+
+// Maximum nesting of stages
+#define MAX_STAGE_DEPTH 8
+
+typedef enum {
+  STAGE_LOAD,
+  STAGE_TRANSFORM,
+  STAGE_NORMALS,
+  STAGE_SETUP,
+  STAGE_RASTER,
+  STAGE_SHADE,
+  STAGE_PRESENT,
+  N_STAGES
+} Stage;
+
+typedef struct {
+  int frame, width, height;
+
+  // Wall time (in seconds) spent in each stage. Nested
+  //    stages are excluded from their parent's time
+  double time[N_STAGES];
+
+  // Counters
+  long triangles_in, triangles_culled, triangles_degenerate;
+  long fragments_tested, fragments_passed, pixels_shaded;
+
+  // Occlusion culling counters: clusters tested, outside
+  //    the window and hidden by the first pass
+  long clusters_tested, clusters_culled, clusters_occluded;
+
+  // Meshlet culling counters: meshlets tested and
+  //    rejected (outside the frustum or back-facing)
+  long meshlets_tested, meshlets_culled;
+
+  // Stack of active stages
+  Stage active[MAX_STAGE_DEPTH];
+  int depth;
+  double last;
+
+  // Optional hook, called whenever a stage in the
+  //    hook_stages mask begins or ends. It receives
+  //    the stage that was active until that moment
+  //    (N_STAGES if there wasn't any). Time spent in
+  //    the hook isn't attributed to any stage.
+  void (*hook)(void *data, Stage active);
+  void *hook_data;
+  unsigned int hook_stages;
+} FrameStats;
+
+// Monotonic clock, in seconds
+double now_seconds();
+
+/*
+ * Clear every timer and counter and start a new
+ * frame. Stats accumulate until the next reset, so
+ * that a frame can span several calls (e.g., loading
+ * and rasterization). The hook is kept.
+ * */
+void reset_stats(FrameStats *stats);
+
+/*
+ * Mark the beginning and end of a stage. Stages can
+ * be nested and every function accepts NULL, in which
+ * case nothing is recorded.
+ * */
+void begin_stage(FrameStats *stats, Stage stage);
+void end_stage(FrameStats *stats, Stage stage);
+
+/*
+ * Add the stats recorded by the n workers of a parallel
+ * stage, which took wall seconds (already attributed to
+ * stage). Counters are added, while the wall time is
+ * split among the stages in proportion to the time the
+ * workers spent in each of them.
+ * */
+void merge_worker_stats(FrameStats *stats, FrameStats *workers, int n,
+                        Stage stage, double wall);
+
+// Utilities
+const char *stage_name(Stage stage);
+double total_time(FrameStats *stats);
+
+/*
+ * Write the stats of a frame as a single line
+ * JSON object.
+ * */
+void write_stats_json(FrameStats *stats, FILE *fp);
+
+#endif
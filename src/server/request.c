@@ -0,0 +1,367 @@
+#include "request.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Camera parameters of a request, NAN until given
+typedef struct {
+  double C[3], N[3], V[3];
+  double d, hx, hy;
+} CameraParameters;
+
+// Catalog
+Resource *find_resource(Resource *resources, int n, char *name);
+char *resource_name(char *path);
+
+// Parsing
+bool parse_triple(char *value, double *dst);
+bool parse_positive(char *value, double *dst);
+void camera_parameters(Camera *camera, CameraParameters *params);
+bool validate_camera(CameraParameters *params, char *error, size_t size);
+
+// Output
+void pack_canvas(Color **canvas, uint8_t *dst, int width, int height,
+                 int channels);
+
+Catalog *create_catalog() {
+  Catalog *catalog = (Catalog *)calloc(1, sizeof(Catalog));
+  assert(catalog != NULL);
+  return catalog;
+}
+
+char *resource_name(char *path) {
+  // Strip the directory and the extension
+  char *base = path;
+  for (char *c = path; *c != '\0'; c++) {
+    if (*c == '/' || *c == '\\') {
+      base = c + 1;
+    }
+  }
+
+  char *dot = strrchr(base, '.');
+  size_t length = (dot != NULL && dot != base) ? (size_t)(dot - base)
+                                               : strlen(base);
+  char *name = (char *)malloc(length + 1);
+  assert(name != NULL);
+  memcpy(name, base, length);
+  name[length] = '\0';
+  return name;
+}
+
+Resource *find_resource(Resource *resources, int n, char *name) {
+  for (int i = 0; i < n; i++) {
+    if (strcmp(resources[i].name, name) == 0) {
+      return resources + i;
+    }
+  }
+
+  return NULL;
+}
+
+bool add_resource(Catalog *catalog, char kind, char *path) {
+  Resource **resources;
+  int *n;
+  switch (kind) {
+  case 'm':
+    resources = &catalog->meshes;
+    n = &catalog->n_meshes;
+    break;
+  case 'l':
+    resources = &catalog->lights;
+    n = &catalog->n_lights;
+    break;
+  default:
+    assert(kind == 'c');
+    resources = &catalog->cameras;
+    n = &catalog->n_cameras;
+  }
+
+  char *name = resource_name(path);
+  if (find_resource(*resources, *n, name) != NULL) {
+    free(name);
+    return false;
+  }
+
+  *resources = (Resource *)realloc(*resources, (*n + 1) * sizeof(Resource));
+  assert(*resources != NULL);
+  Resource *resource = *resources + (*n)++;
+  resource->name = name;
+  switch (kind) {
+  case 'm':
+    resource->data = load_object(path);
+    break;
+  case 'l':
+    resource->data = load_light(path);
+    break;
+  default:
+    resource->data = load_camera(path);
+  }
+
+  return true;
+}
+
+bool parse_triple(char *value, double *dst) {
+  int end = 0;
+  return sscanf(value, "%lf,%lf,%lf%n", dst, dst + 1, dst + 2, &end) == 3 &&
+         value[end] == '\0' && isfinite(dst[0]) && isfinite(dst[1]) &&
+         isfinite(dst[2]);
+}
+
+bool parse_positive(char *value, double *dst) {
+  char *end;
+  *dst = strtod(value, &end);
+  return end != value && *end == '\0' && isfinite(*dst) && *dst > 0.0;
+}
+
+void camera_parameters(Camera *camera, CameraParameters *params) {
+  for (int i = 0; i < 3; i++) {
+    params->C[i] = camera->C->arr[i];
+    params->N[i] = camera->N->arr[i];
+    params->V[i] = camera->V->arr[i];
+  }
+  params->d = camera->d;
+  params->hx = camera->hx;
+  params->hy = camera->hy;
+}
+
+bool validate_camera(CameraParameters *params, char *error, size_t size) {
+  double values[] = {params->C[0], params->C[1], params->C[2],
+                     params->N[0], params->N[1], params->N[2],
+                     params->V[0], params->V[1], params->V[2],
+                     params->d,    params->hx,   params->hy};
+  for (int i = 0; i < 12; i++) {
+    if (isnan(values[i])) {
+      snprintf(error, size, "incomplete camera");
+      return false;
+    }
+  }
+
+  // The converter needs N and a V that isn't parallel
+  //    to it, otherwise the camera basis is degenerate
+  double *N = params->N, *V = params->V;
+  double cross[3] = {N[1] * V[2] - N[2] * V[1], N[2] * V[0] - N[0] * V[2],
+                     N[0] * V[1] - N[1] * V[0]};
+  double n_norm = sqrt(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+  double v_norm = sqrt(V[0] * V[0] + V[1] * V[1] + V[2] * V[2]);
+  double c_norm =
+      sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+  if (n_norm == 0.0 || v_norm == 0.0 || c_norm <= 1e-6 * n_norm * v_norm) {
+    snprintf(error, size, "degenerate camera basis");
+    return false;
+  }
+
+  return true;
+}
+
+bool parse_request(char *line, Catalog *catalog, RenderOptions *options,
+                   RenderRequest *request, char *error, size_t size) {
+  CameraParameters params = {{NAN, NAN, NAN}, {NAN, NAN, NAN},
+                             {NAN, NAN, NAN}, NAN, NAN, NAN};
+  request->mesh = NULL;
+  request->light = NULL;
+  request->camera = NULL;
+  request->width = request->height = 0;
+  request->options = *options;
+  request->output[0] = '\0';
+
+  // Arguments are key=value pairs separated by spaces.
+  //    A named camera is only a starting point, so its
+  //    parameters can be overridden in any order
+  Resource *camera = NULL;
+  char *save, *token;
+  for (token = strtok_r(line, " \t\r\n", &save); token != NULL;
+       token = strtok_r(NULL, " \t\r\n", &save)) {
+    char *value = strchr(token, '=');
+    if (value == NULL) {
+      snprintf(error, size, "malformed argument %.64s", token);
+      return false;
+    }
+    *value++ = '\0';
+
+    bool ok = true;
+    if (strcmp(token, "mesh") == 0) {
+      Resource *r = find_resource(catalog->meshes, catalog->n_meshes, value);
+      request->mesh = (r != NULL) ? (Object *)r->data : NULL;
+      ok = r != NULL;
+    } else if (strcmp(token, "light") == 0) {
+      Resource *r = find_resource(catalog->lights, catalog->n_lights, value);
+      request->light = (r != NULL) ? (Light *)r->data : NULL;
+      ok = r != NULL;
+    } else if (strcmp(token, "camera") == 0) {
+      camera = find_resource(catalog->cameras, catalog->n_cameras, value);
+      ok = camera != NULL;
+    } else if (strcmp(token, "size") == 0) {
+      int end = 0;
+      ok = sscanf(value, "%dx%d%n", &request->width, &request->height,
+                  &end) == 2 &&
+           value[end] == '\0';
+    } else if (strcmp(token, "C") == 0) {
+      ok = parse_triple(value, params.C);
+    } else if (strcmp(token, "N") == 0) {
+      ok = parse_triple(value, params.N);
+    } else if (strcmp(token, "V") == 0) {
+      ok = parse_triple(value, params.V);
+    } else if (strcmp(token, "d") == 0) {
+      ok = parse_positive(value, &params.d);
+    } else if (strcmp(token, "hx") == 0) {
+      ok = parse_positive(value, &params.hx);
+    } else if (strcmp(token, "hy") == 0) {
+      ok = parse_positive(value, &params.hy);
+    } else if (strcmp(token, "samples") == 0) {
+      int samples = atoi(value);
+      request->options.samples = samples;
+      ok = samples == 1 || samples == 2 || samples == 4 || samples == 8;
+    } else if (strcmp(token, "mode") == 0) {
+      ok = parse_render_mode(value, &request->options.mode);
+    } else if (strcmp(token, "shading") == 0) {
+      ok = parse_shading_model(value, &request->options.shading);
+    } else if (strcmp(token, "output") == 0) {
+      snprintf(request->output, sizeof(request->output), "%s", value);
+      ok = value[0] != '\0';
+    } else {
+      snprintf(error, size, "unknown argument %.64s", token);
+      return false;
+    }
+
+    if (!ok) {
+      snprintf(error, size, "invalid %s: %.64s", token, value);
+      return false;
+    }
+
+    // Fill the parameters that weren't given yet
+    if (camera != NULL) {
+      CameraParameters named;
+      camera_parameters((Camera *)camera->data, &named);
+      double *src = (double *)&named, *dst = (double *)&params;
+      for (size_t i = 0; i < sizeof(params) / sizeof(double); i++) {
+        dst[i] = isnan(dst[i]) ? src[i] : dst[i];
+      }
+      camera = NULL;
+    }
+  }
+
+  if (request->mesh == NULL || request->light == NULL) {
+    snprintf(error, size, "mesh and light are required");
+    return false;
+  }
+
+  if (request->width <= 0 || request->height <= 0 ||
+      request->width > MAX_IMAGE_SIZE || request->height > MAX_IMAGE_SIZE) {
+    snprintf(error, size, "size must be within 1x1 and %dx%d",
+             MAX_IMAGE_SIZE, MAX_IMAGE_SIZE);
+    return false;
+  }
+
+  if (!validate_camera(&params, error, size)) {
+    return false;
+  }
+
+  request->camera = (Camera *)malloc(sizeof(Camera));
+  assert(request->camera != NULL);
+  request->camera->C =
+      create_vector(3, POINT, params.C[0], params.C[1], params.C[2]);
+  request->camera->N =
+      create_vector(3, POINT, params.N[0], params.N[1], params.N[2]);
+  request->camera->V =
+      create_vector(3, POINT, params.V[0], params.V[1], params.V[2]);
+  request->camera->d = params.d;
+  request->camera->hx = params.hx;
+  request->camera->hy = params.hy;
+  return true;
+}
+
+void pack_canvas(Color **canvas, uint8_t *dst, int width, int height,
+                 int channels) {
+  for (int i = 0; i < height; i++) {
+    uint8_t *row = dst + (size_t)channels * width * i;
+    for (int j = 0; j < width; j++) {
+      Color c = canvas[i][j];
+      uint8_t *p = row + channels * j;
+      p[0] = (uint8_t)(c.r < 0 ? 0 : (c.r > 255 ? 255 : c.r));
+      p[1] = (uint8_t)(c.g < 0 ? 0 : (c.g > 255 ? 255 : c.g));
+      p[2] = (uint8_t)(c.b < 0 ? 0 : (c.b > 255 ? 255 : c.b));
+      if (channels == 4) {
+        p[3] = 255;
+      }
+    }
+  }
+}
+
+bool serve_request(RenderRequest *request, FILE *out) {
+  // Each request renders its own scene on top of
+  //    the resident mesh and light
+  int w = request->width, h = request->height;
+  Scene *scene = scene_from_mesh(copy_camera(request->camera),
+                                 request->light, request->mesh);
+  Color **canvas = rasterize(scene, w, h, &request->options, NULL);
+  destroy_shared_scene(scene);
+
+  // Either written to a file (RGB) or sent
+  //    right after the reply (RGBA)
+  int channels = (request->output[0] != '\0') ? 3 : 4;
+  size_t size = (size_t)channels * w * h;
+  uint8_t *pixels = (uint8_t *)malloc(size);
+  assert(pixels != NULL);
+  pack_canvas(canvas, pixels, w, h, channels);
+  destroy_canvas(canvas, w, h);
+
+  bool ok;
+  if (channels == 4) {
+    ok = fprintf(out, "ok %d %d %zu\n", w, h, size) > 0 &&
+         fwrite(pixels, 1, size, out) == size;
+  } else {
+    FILE *fp = fopen(request->output, "wb");
+    bool written = fp != NULL && fprintf(fp, "P6\n%d %d\n255\n", w, h) > 0 &&
+                   fwrite(pixels, 1, size, fp) == size;
+    written = (fp != NULL && fclose(fp) == 0) && written;
+    ok = written ? fprintf(out, "ok %s\n", request->output) > 0
+                 : fprintf(out, "error can't write %s\n", request->output) > 0;
+  }
+
+  free(pixels);
+  return ok && fflush(out) == 0;
+}
+
+bool list_catalog(Catalog *catalog, FILE *out) {
+  Resource *resources[] = {catalog->meshes, catalog->lights, catalog->cameras};
+  int counts[] = {catalog->n_meshes, catalog->n_lights, catalog->n_cameras};
+  char *kinds[] = {"mesh", "light", "camera"};
+
+  fprintf(out, "ok");
+  for (int k = 0; k < 3; k++) {
+    for (int i = 0; i < counts[k]; i++) {
+      fprintf(out, " %s=%s", kinds[k], resources[k][i].name);
+    }
+  }
+  fprintf(out, "\n");
+  return fflush(out) == 0;
+}
+
+void destroy_request(RenderRequest *request) {
+  if (request->camera != NULL) {
+    destroy_camera(request->camera);
+    request->camera = NULL;
+  }
+}
+
+void destroy_catalog(Catalog *catalog) {
+  for (int i = 0; i < catalog->n_meshes; i++) {
+    destroy_object((Object *)catalog->meshes[i].data);
+    free(catalog->meshes[i].name);
+  }
+  for (int i = 0; i < catalog->n_lights; i++) {
+    destroy_light((Light *)catalog->lights[i].data);
+    free(catalog->lights[i].name);
+  }
+  for (int i = 0; i < catalog->n_cameras; i++) {
+    destroy_camera((Camera *)catalog->cameras[i].data);
+    free(catalog->cameras[i].name);
+  }
+
+  free(catalog->meshes);
+  free(catalog->lights);
+  free(catalog->cameras);
+  free(catalog);
+}
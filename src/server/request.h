@@ -0,0 +1,75 @@
+#ifndef SERVER_REQUEST
+#define SERVER_REQUEST
+#include "../core/scene.h"
+#include "../rendering/scanline.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// Maximum length of a request line
+#define REQUEST_LINE_SIZE 4096
+
+// Maximum width and height of a rendered image
+#define MAX_IMAGE_SIZE 8192
+
+// Resident resource, identified by the name of its
+//    file without directory and extension
+typedef struct {
+  char *name;
+  void *data;
+} Resource;
+
+/*
+ * Meshes, lights and cameras loaded once at startup and
+ * shared (read-only) by every request.
+ * */
+typedef struct {
+  Resource *meshes, *lights, *cameras;
+  int n_meshes, n_lights, n_cameras;
+} Catalog;
+
+typedef struct {
+  // Resident resources (not owned by the request)
+  Object *mesh;
+  Light *light;
+
+  Camera *camera;
+  int width, height;
+  RenderOptions options;
+
+  // Path where the image is written (as a binary PPM)
+  //    or empty, in which case it's sent in the reply
+  char output[REQUEST_LINE_SIZE];
+} RenderRequest;
+
+Catalog *create_catalog();
+
+/*
+ * Load a resource into the catalog, where kind is 'm'
+ * (mesh), 'l' (light) or 'c' (camera). Returns false if
+ * its name is already taken.
+ * */
+bool add_resource(Catalog *catalog, char kind, char *path);
+
+/*
+ * Parse a request line (see the protocol in server.c),
+ * where options holds the default render options. On
+ * failure, returns false and a message is written into
+ * error.
+ * */
+bool parse_request(char *line, Catalog *catalog, RenderOptions *options,
+                   RenderRequest *request, char *error, size_t size);
+
+/*
+ * Render a request and send the reply to out. Returns
+ * false if the reply couldn't be written.
+ * */
+bool serve_request(RenderRequest *request, FILE *out);
+
+// Write the names of the resources, as the reply of list
+bool list_catalog(Catalog *catalog, FILE *out);
+
+// Cleanup
+void destroy_request(RenderRequest *request);
+void destroy_catalog(Catalog *catalog);
+
+#endif
@@ -0,0 +1,413 @@
+#include "../rendering/scanline.h"
+#include "../rendering/stats.h"
+#include "request.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Number of accepted connections that can wait
+//    for a free worker
+#define SERVER_QUEUE_SIZE 64
+
+/*
+ * Protocol: a client connects to the socket and sends
+ * one request per line, each answered in order by a single
+ * reply line (and, possibly, the image):
+ *
+ *    render mesh=<name> light=<name> size=<W>x<H>
+ *           [camera=<name>] [C=x,y,z] [N=x,y,z] [V=x,y,z]
+ *           [d=<d>] [hx=<hx>] [hy=<hy>] [samples=<n>]
+ *           [mode=<mode>] [shading=<shading>] [output=<path>]
+ *       -> "ok <W> <H> <bytes>" followed by the RGBA pixels
+ *          (row major, top to bottom), or "ok <path>" once
+ *          the image is written to path as a binary PPM
+ *    list
+ *       -> "ok mesh=<name> ... light=<name> ... camera=..."
+ *
+ * Errors are answered with "error <message>" and the
+ * connection is kept. Names are the resident files,
+ * without directory and extension. The camera is either
+ * a resident one, whose parameters can be overridden, or
+ * given by every parameter.
+ * */
+
+typedef struct {
+  int listener;
+  Catalog *catalog;
+  RenderOptions options;
+  int n_workers, raster_workers;
+  pthread_t *threads;
+
+  // Accepted connections, waiting for a worker
+  int queue[SERVER_QUEUE_SIZE];
+  int head, count;
+  bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  // Connection served by each worker (-1 if idle),
+  //    so that they can be interrupted on shutdown
+  int *active;
+} Server;
+
+typedef struct {
+  Server *server;
+  int id;
+  TaskScheduler *scheduler;
+} ServerWorker;
+
+// Set by the signal handler
+volatile sig_atomic_t interrupted = 0;
+
+void usage(char *program);
+void handle_signal(int signal);
+
+// Socket
+int open_listener(char *path);
+
+// Workers
+void *server_worker_main(void *data);
+void serve_connection(ServerWorker *worker, int fd);
+bool dispatch_line(ServerWorker *worker, char *line, FILE *out);
+
+void usage(char *program) {
+  fprintf(stderr,
+          "Usage: %s [-s socket] [-p pool] [-j workers] [-a samples] "
+          "[-m mode] [-l shading] {-o object.byu | -i light.lux | "
+          "-c camera.txt}...\n",
+          program);
+  exit(1);
+}
+
+void handle_signal(int signal) {
+  (void)signal;
+  interrupted = 1;
+}
+
+int main(int argc, char *argv[]) {
+  char *path = "render.sock";
+  Server server = {0};
+  server.options = default_render_options();
+  server.catalog = create_catalog();
+  server.n_workers = available_cores();
+  server.raster_workers = 1;
+
+  // Options and resident resources, which can be
+  //    given several times
+  for (int i = 1; i < argc; i += 2) {
+    if (argv[i][0] != '-' || i + 1 >= argc) {
+      usage(argv[0]);
+    }
+    char *value = argv[i + 1];
+    switch (argv[i][1]) {
+    case 's':
+      path = value;
+      break;
+    case 'p':
+      server.n_workers = atoi(value);
+      break;
+    case 'j':
+      server.raster_workers = atoi(value);
+      break;
+    case 'a':
+      server.options.samples = atoi(value);
+      break;
+    case 'm':
+      if (!parse_render_mode(value, &server.options.mode)) {
+        usage(argv[0]);
+      }
+      break;
+    case 'l':
+      if (!parse_shading_model(value, &server.options.shading)) {
+        usage(argv[0]);
+      }
+      break;
+    case 'o':
+    case 'i':
+    case 'c': {
+      char kind = (argv[i][1] == 'o') ? 'm' : (argv[i][1] == 'i' ? 'l' : 'c');
+      if (!add_resource(server.catalog, kind, value)) {
+        fprintf(stderr, "[server] Nome repetido: %s.\n", value);
+        return 1;
+      }
+      break;
+    }
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (server.n_workers <= 0 || server.catalog->n_meshes == 0 ||
+      server.catalog->n_lights == 0) {
+    usage(argv[0]);
+  }
+
+  // Clients that disconnect make the writes fail,
+  //    while interruptions stop accepting connections
+  struct sigaction action = {0};
+  action.sa_handler = handle_signal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  server.listener = open_listener(path);
+  if (server.listener < 0) {
+    fprintf(stderr, "[server] Não foi possível escutar em %s: %s.\n", path,
+            strerror(errno));
+    return 1;
+  }
+
+  // Start the pool, where each worker has its own
+  //    scheduler, since a scheduler runs one frame
+  //    at a time. Signals are blocked meanwhile, so
+  //    that only this thread handles them
+  sigset_t signals, previous;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, &previous);
+  int n = server.n_workers;
+  pthread_mutex_init(&server.lock, NULL);
+  pthread_cond_init(&server.changed, NULL);
+  server.threads = (pthread_t *)malloc(n * sizeof(pthread_t));
+  server.active = (int *)malloc(n * sizeof(int));
+  ServerWorker *workers = (ServerWorker *)malloc(n * sizeof(ServerWorker));
+  assert(server.threads != NULL && server.active != NULL && workers != NULL);
+  for (int i = 0; i < n; i++) {
+    server.active[i] = -1;
+    workers[i].server = &server;
+    workers[i].id = i;
+    workers[i].scheduler = create_scheduler(server.raster_workers);
+    int error = pthread_create(server.threads + i, NULL, server_worker_main,
+                               workers + i);
+    assert(error == 0);
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+  printf("[server] Escutando em %s com %d worker(s) (%d mesh(es), %d "
+         "luz(es), %d câmera(s)).\n",
+         path, n, server.catalog->n_meshes, server.catalog->n_lights,
+         server.catalog->n_cameras);
+  fflush(stdout);
+
+  while (!interrupted) {
+    int fd = accept(server.listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EINTR) {
+        fprintf(stderr, "[server] Falha ao aceitar conexão: %s.\n",
+                strerror(errno));
+      }
+      continue;
+    }
+
+    // Wait for room in the queue
+    pthread_mutex_lock(&server.lock);
+    while (server.count == SERVER_QUEUE_SIZE && !interrupted) {
+      pthread_cond_wait(&server.changed, &server.lock);
+    }
+    if (interrupted) {
+      pthread_mutex_unlock(&server.lock);
+      close(fd);
+      break;
+    }
+    server.queue[(server.head + server.count) % SERVER_QUEUE_SIZE] = fd;
+    server.count++;
+    pthread_cond_broadcast(&server.changed);
+    pthread_mutex_unlock(&server.lock);
+  }
+
+  // Stop the workers: connections waiting in the queue
+  //    are dropped, while the ones being served finish
+  //    their current request
+  printf("[server] Encerrando...\n");
+  pthread_mutex_lock(&server.lock);
+  server.stop = true;
+  for (; server.count > 0; server.count--) {
+    close(server.queue[server.head]);
+    server.head = (server.head + 1) % SERVER_QUEUE_SIZE;
+  }
+  for (int i = 0; i < n; i++) {
+    if (server.active[i] >= 0) {
+      shutdown(server.active[i], SHUT_RD);
+    }
+  }
+  pthread_cond_broadcast(&server.changed);
+  pthread_mutex_unlock(&server.lock);
+
+  // Cleanup
+  for (int i = 0; i < n; i++) {
+    pthread_join(server.threads[i], NULL);
+    destroy_scheduler(workers[i].scheduler);
+  }
+  close(server.listener);
+  unlink(path);
+  pthread_mutex_destroy(&server.lock);
+  pthread_cond_destroy(&server.changed);
+  free(workers);
+  free(server.threads);
+  free(server.active);
+  destroy_catalog(server.catalog);
+  return 0;
+}
+
+int open_listener(char *path) {
+  struct sockaddr_un address = {0};
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    // A leftover socket (e.g., from a server that
+    //    crashed) is replaced, unless another server
+    //    is still accepting connections on it
+    int probe = (errno == EADDRINUSE) ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+    bool alive = probe >= 0 && connect(probe, (struct sockaddr *)&address,
+                                       sizeof(address)) == 0;
+    if (probe >= 0) {
+      close(probe);
+    }
+    if (probe < 0 || alive || unlink(path) < 0 ||
+        bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+      int error = alive ? EADDRINUSE : errno;
+      close(fd);
+      errno = error;
+      return -1;
+    }
+  }
+
+  if (listen(fd, SERVER_QUEUE_SIZE) < 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+
+  return fd;
+}
+
+void *server_worker_main(void *data) {
+  ServerWorker *worker = (ServerWorker *)data;
+  Server *server = worker->server;
+
+  pthread_mutex_lock(&server->lock);
+  while (true) {
+    while (server->count == 0 && !server->stop) {
+      pthread_cond_wait(&server->changed, &server->lock);
+    }
+
+    if (server->stop) {
+      break;
+    }
+
+    int fd = server->queue[server->head];
+    server->head = (server->head + 1) % SERVER_QUEUE_SIZE;
+    server->count--;
+    server->active[worker->id] = fd;
+    pthread_cond_broadcast(&server->changed);
+    pthread_mutex_unlock(&server->lock);
+
+    serve_connection(worker, fd);
+
+    pthread_mutex_lock(&server->lock);
+    server->active[worker->id] = -1;
+    close(fd);
+  }
+  pthread_mutex_unlock(&server->lock);
+
+  return NULL;
+}
+
+void serve_connection(ServerWorker *worker, int fd) {
+  // Separate streams for reading and writing, closing
+  //    them leaves fd to the caller
+  int in_fd = dup(fd), out_fd = dup(fd);
+  FILE *in = (in_fd >= 0) ? fdopen(in_fd, "r") : NULL;
+  FILE *out = (out_fd >= 0) ? fdopen(out_fd, "w") : NULL;
+  if (in == NULL || out == NULL) {
+    fprintf(stderr, "[server] Falha ao abrir conexão: %s.\n",
+            strerror(errno));
+  }
+
+  char line[REQUEST_LINE_SIZE];
+  bool ok = in != NULL && out != NULL;
+  while (ok && fgets(line, sizeof(line), in) != NULL) {
+    if (strchr(line, '\n') == NULL && !feof(in)) {
+      // The rest of the line can't be told apart from
+      //    a new request, so the connection is dropped
+      fprintf(out, "error request longer than %d bytes\n",
+              REQUEST_LINE_SIZE - 1);
+      break;
+    }
+    ok = dispatch_line(worker, line, out);
+  }
+
+  // Cleanup
+  if (in != NULL) {
+    fclose(in);
+  } else if (in_fd >= 0) {
+    close(in_fd);
+  }
+  if (out != NULL) {
+    fclose(out);
+  } else if (out_fd >= 0) {
+    close(out_fd);
+  }
+}
+
+bool dispatch_line(ServerWorker *worker, char *line, FILE *out) {
+  Server *server = worker->server;
+  char *arguments = line + strspn(line, " \t\r\n");
+  char *command = arguments;
+  arguments += strcspn(arguments, " \t\r\n");
+  if (*arguments != '\0') {
+    *arguments++ = '\0';
+  }
+
+  if (*command == '\0') {
+    // Empty lines are ignored
+    return true;
+  }
+
+  if (strcmp(command, "list") == 0) {
+    return list_catalog(server->catalog, out);
+  }
+
+  if (strcmp(command, "render") != 0) {
+    fprintf(out, "error unknown command %.64s\n", command);
+    return fflush(out) == 0;
+  }
+
+  RenderRequest request;
+  char error[256];
+  if (!parse_request(arguments, server->catalog, &server->options, &request,
+                     error, sizeof(error))) {
+    destroy_request(&request);
+    fprintf(out, "error %s\n", error);
+    return fflush(out) == 0;
+  }
+
+  request.options.scheduler = worker->scheduler;
+  double start = now_seconds();
+  bool ok = serve_request(&request, out);
+  printf("[server] %dx%d em %.2f ms (worker %d).\n", request.width,
+         request.height, 1e3 * (now_seconds() - start), worker->id);
+  fflush(stdout);
+
+  destroy_request(&request);
+  return ok;
+}
@@ -0,0 +1,164 @@
+#include "shared.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// Slots start at page boundaries, with the pixels
+//    one cache line after the start of the slot
+#define SHARED_ALIGNMENT 4096
+#define SHARED_PIXELS_OFFSET 64
+
+struct SharedFramebuffer {
+  char *name;
+  SharedHeader *header;
+  size_t size;
+
+  // Number of the current frame and its slot
+  uint64_t frame;
+  SharedSlot *slot;
+};
+
+// Layout
+size_t align_shared(size_t size);
+SharedSlot *shared_slot(SharedHeader *header, uint64_t frame);
+void wake_consumers(SharedHeader *header);
+
+size_t align_shared(size_t size) {
+  return (size + SHARED_ALIGNMENT - 1) / SHARED_ALIGNMENT * SHARED_ALIGNMENT;
+}
+
+SharedSlot *shared_slot(SharedHeader *header, uint64_t frame) {
+  size_t offset = header->slot_offset +
+                  (size_t)(frame % header->n_slots) * header->slot_size;
+  return (SharedSlot *)((uint8_t *)header + offset);
+}
+
+SharedFramebuffer *open_shared_framebuffer(char *name, int width,
+                                           int height) {
+#ifdef _WIN32
+  (void)name;
+  (void)width;
+  (void)height;
+  return NULL;
+#else
+  size_t stride = (size_t)4 * width;
+  size_t slot_size = align_shared(SHARED_PIXELS_OFFSET + stride * height);
+  size_t slot_offset = align_shared(sizeof(SharedHeader));
+  size_t size = slot_offset + SHARED_SLOTS * slot_size;
+
+  // Replace any leftover object, so that consumers
+  //    never see a header from a previous run
+  shm_unlink(name);
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, (off_t)size) < 0) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  // The object starts zeroed, so only the layout is
+  //    filled. The magic is written last, once the
+  //    rest of the header is valid
+  SharedHeader *header = (SharedHeader *)memory;
+  header->version = SHARED_VERSION;
+  header->width = width;
+  header->height = height;
+  header->stride = stride;
+  header->n_slots = SHARED_SLOTS;
+  header->slot_offset = slot_offset;
+  header->slot_size = slot_size;
+  header->pixels_offset = SHARED_PIXELS_OFFSET;
+  for (int k = 0; k < SHARED_SLOTS; k++) {
+    shared_slot(header, k)->size = stride * height;
+  }
+  atomic_thread_fence(memory_order_release);
+  header->magic = SHARED_MAGIC;
+
+  SharedFramebuffer *framebuffer =
+      (SharedFramebuffer *)malloc(sizeof(SharedFramebuffer));
+  assert(framebuffer != NULL);
+  framebuffer->name = (char *)malloc(strlen(name) + 1);
+  assert(framebuffer->name != NULL);
+  strcpy(framebuffer->name, name);
+  framebuffer->header = header;
+  framebuffer->size = size;
+  framebuffer->frame = 0;
+  framebuffer->slot = NULL;
+  return framebuffer;
+#endif
+}
+
+uint8_t *begin_shared_frame(SharedFramebuffer *framebuffer) {
+  assert(framebuffer->slot == NULL);
+  SharedSlot *slot = shared_slot(framebuffer->header, framebuffer->frame);
+  framebuffer->slot = slot;
+
+  // Consumers still reading the frame of this slot
+  //    must notice that it's being overwritten
+  atomic_store_explicit(&slot->ready, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  return (uint8_t *)slot + framebuffer->header->pixels_offset;
+}
+
+void publish_shared_frame(SharedFramebuffer *framebuffer) {
+  SharedHeader *header = framebuffer->header;
+  SharedSlot *slot = framebuffer->slot;
+  assert(slot != NULL);
+
+  atomic_store_explicit(&slot->frame, framebuffer->frame,
+                        memory_order_relaxed);
+  atomic_store_explicit(&slot->ready, 1, memory_order_release);
+  atomic_store_explicit(&header->latest, framebuffer->frame,
+                        memory_order_release);
+  atomic_fetch_add_explicit(&header->sequence, 1, memory_order_release);
+  wake_consumers(header);
+
+  framebuffer->frame++;
+  framebuffer->slot = NULL;
+}
+
+void wake_consumers(SharedHeader *header) {
+#ifdef __linux__
+  // Shared (not private) futex, since the waiters
+  //    live in other processes
+  syscall(SYS_futex, (uint32_t *)&header->sequence, FUTEX_WAKE, INT_MAX, NULL,
+          NULL, 0);
+#else
+  // Consumers poll the sequence
+  (void)header;
+#endif
+}
+
+void close_shared_framebuffer(SharedFramebuffer *framebuffer) {
+  SharedHeader *header = framebuffer->header;
+  atomic_store_explicit(&header->closed, 1, memory_order_release);
+  atomic_fetch_add_explicit(&header->sequence, 1, memory_order_release);
+  wake_consumers(header);
+
+  // Cleanup
+#ifndef _WIN32
+  munmap(header, framebuffer->size);
+  shm_unlink(framebuffer->name);
+#endif
+  free(framebuffer->name);
+  free(framebuffer);
+}
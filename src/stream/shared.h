@@ -0,0 +1,85 @@
+#ifndef STREAM_SHARED
+#define STREAM_SHARED
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Identifies the layout below ("CGFB" in little endian)
+#define SHARED_MAGIC 0x42464743u
+#define SHARED_VERSION 1u
+
+// Number of framebuffers of the ring
+#define SHARED_SLOTS 3
+
+/*
+ * Shared memory object (POSIX shm_open) holding a header
+ * followed by a ring of framebuffers, which a renderer
+ * paints in place and local consumers (e.g., compositors
+ * or encoders) map and read without any copy. Frames are
+ * numbered from 0 and frame k goes to slot k % n_slots.
+ *
+ * The producer never waits for consumers: before painting
+ * a slot it clears ready, and once the frame is complete
+ * it stores the frame number, sets ready and updates
+ * latest, then increments sequence and wakes the waiters
+ * (on Linux, sequence is a futex). A consumer waits for
+ * sequence to change, reads the slot of latest and, after
+ * using the pixels, checks that the slot is still ready
+ * and holds the same frame, otherwise the producer lapped
+ * it and the frame must be discarded.
+ * */
+typedef struct {
+  uint32_t magic, version;
+
+  // Frame size, in pixels, and bytes per row of
+  //    the 8-bit RGBA pixels (top to bottom)
+  uint32_t width, height, stride;
+
+  // Slot k starts at slot_offset + k * slot_size
+  //    bytes from the header, with its pixels at
+  //    pixels_offset bytes from the slot
+  uint32_t n_slots;
+  uint64_t slot_offset, slot_size, pixels_offset;
+
+  _Atomic uint64_t latest;
+  _Atomic uint32_t sequence;
+
+  // Set once the producer is done
+  _Atomic uint32_t closed;
+} SharedHeader;
+
+typedef struct {
+  _Atomic uint64_t frame;
+  _Atomic uint32_t ready;
+
+  // Size of the pixels, in bytes
+  uint32_t size;
+} SharedSlot;
+
+typedef struct SharedFramebuffer SharedFramebuffer;
+
+/*
+ * Create the shared memory object name (e.g., "/frames",
+ * see shm_open) for frames of the given size, replacing
+ * an existing one. Returns NULL if it can't be created
+ * (or on systems without POSIX shared memory).
+ * */
+SharedFramebuffer *open_shared_framebuffer(char *name, int width,
+                                           int height);
+
+/*
+ * Start the next frame, returning the pixels of its slot,
+ * which must be painted before publishing it.
+ * */
+uint8_t *begin_shared_frame(SharedFramebuffer *framebuffer);
+
+// Mark the current frame as complete and wake consumers
+void publish_shared_frame(SharedFramebuffer *framebuffer);
+
+/*
+ * Mark the ring as closed and remove its name. Consumers
+ * that mapped it can keep reading the last frames.
+ * */
+void close_shared_framebuffer(SharedFramebuffer *framebuffer);
+
+#endif
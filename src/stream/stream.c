@@ -0,0 +1,182 @@
+#include "../core/scene.h"
+#include "../core/vectors.h"
+#include "../rendering/scanline.h"
+#include "../rendering/stats.h"
+#include "shared.h"
+#include "video.h"
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+typedef struct {
+  char *output;
+  StreamFormat format;
+  int frames, width, height, fps, workers;
+  RenderOptions options;
+} StreamConfig;
+
+void usage(char *program);
+void wait_until(double deadline);
+
+void usage(char *program) {
+  fprintf(stderr,
+          "Usage: %s [-f y4m|rgba|shm] [-n frames] [-r WxH] [-t fps] "
+          "[-a samples] [-m mode] [-l shading] [-j workers] [-o output] "
+          "<camera.txt> <object.byu> <light.lux>\n",
+          program);
+  exit(1);
+}
+
+void wait_until(double deadline) {
+  double remaining = deadline - now_seconds();
+  if (remaining <= 0.0) {
+    return;
+  }
+
+#ifdef _WIN32
+  Sleep((DWORD)(remaining * 1e3));
+#else
+  struct timespec delay;
+  delay.tv_sec = (time_t)remaining;
+  delay.tv_nsec = (long)((remaining - delay.tv_sec) * 1e9);
+  nanosleep(&delay, NULL);
+#endif
+}
+
+int main(int argc, char *argv[]) {
+  StreamConfig cfg = {"-", STREAM_Y4M, 120, 600, 600, 30, 0,
+                      default_render_options()};
+
+  // Parse options, followed by the scene files
+  int i = 1;
+  for (; i + 1 < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i += 2) {
+    char *value = argv[i + 1];
+    switch (argv[i][1]) {
+    case 'f':
+      if (!parse_stream_format(value, &cfg.format)) {
+        usage(argv[0]);
+      }
+      break;
+    case 'n':
+      cfg.frames = atoi(value);
+      break;
+    case 'r':
+      if (sscanf(value, "%dx%d", &cfg.width, &cfg.height) != 2) {
+        usage(argv[0]);
+      }
+      break;
+    case 't':
+      cfg.fps = atoi(value);
+      break;
+    case 'a':
+      cfg.options.samples = atoi(value);
+      break;
+    case 'm':
+      if (!parse_render_mode(value, &cfg.options.mode)) {
+        usage(argv[0]);
+      }
+      break;
+    case 'l':
+      if (!parse_shading_model(value, &cfg.options.shading)) {
+        usage(argv[0]);
+      }
+      break;
+    case 'j':
+      cfg.workers = atoi(value);
+      break;
+    case 'o':
+      cfg.output = value;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (argc - i != 3 || cfg.frames <= 0 || cfg.fps <= 0) {
+    usage(argv[0]);
+  }
+  if (cfg.format == STREAM_SHM && strcmp(cfg.output, "-") == 0) {
+    cfg.output = "/classic-cg";
+  }
+
+#ifndef _WIN32
+  // A consumer that exits early makes the writes
+  //    fail, instead of killing the process
+  signal(SIGPIPE, SIG_IGN);
+#endif
+
+  Scene *scene = load_scene(argv[i], argv[i + 1], argv[i + 2]);
+  cfg.options.scheduler = create_scheduler(cfg.workers);
+
+  // The stream is opened after loading, since the
+  //    consumer might be waiting on a named pipe.
+  //    Shared memory frames are rendered in place
+  VideoStream *stream = NULL;
+  SharedFramebuffer *framebuffer = NULL;
+  if (cfg.format == STREAM_SHM) {
+    framebuffer = open_shared_framebuffer(cfg.output, cfg.width, cfg.height);
+  } else {
+    stream = open_video_stream(cfg.output, cfg.format, cfg.width, cfg.height,
+                               cfg.fps);
+  }
+  if (stream == NULL && framebuffer == NULL) {
+    fprintf(stderr, "[stream] Não foi possível abrir %s.\n", cfg.output);
+    return 1;
+  }
+  fprintf(stderr, "[stream] %d quadros %dx%d a %d fps (%s).\n", cfg.frames,
+          cfg.width, cfg.height, cfg.fps, stream_format_name(cfg.format));
+
+  // Turntable: a full turn around the pivot of the
+  //    loaded camera. Every frame starts from the loaded
+  //    camera, so errors don't accumulate
+  Camera *initial = copy_camera(scene->camera);
+  Vector *target = orbit_target(scene);
+  double start = now_seconds();
+  bool ok = true;
+  for (int k = 0; k < cfg.frames && ok; k++) {
+    Camera *camera = copy_camera(initial);
+    orbit_camera(camera, target, 360.0 * k / cfg.frames, 0.0);
+    set_scene_camera(scene, camera);
+
+    if (framebuffer != NULL) {
+      cfg.options.target = begin_shared_frame(framebuffer);
+    }
+    Color **canvas =
+        rasterize(scene, cfg.width, cfg.height, &cfg.options, NULL);
+    if (framebuffer != NULL) {
+      // Consumers of shared memory read the latest
+      //    frame, so frames are paced at the frame rate
+      publish_shared_frame(framebuffer);
+      wait_until(start + (k + 1.0) / cfg.fps);
+    } else {
+      ok = write_video_frame(stream, canvas);
+      destroy_canvas(canvas, cfg.width, cfg.height);
+    }
+  }
+  if (framebuffer != NULL) {
+    close_shared_framebuffer(framebuffer);
+  } else {
+    ok = close_video_stream(stream) && ok;
+  }
+
+  double elapsed = now_seconds() - start;
+  if (ok) {
+    fprintf(stderr, "[stream] %d quadros em %.3f s (%.1f fps).\n", cfg.frames,
+            elapsed, cfg.frames / elapsed);
+  } else {
+    fprintf(stderr, "[stream] Falha ao escrever o fluxo.\n");
+  }
+
+  // Cleanup
+  destroy_camera(initial);
+  destroy_vector(target);
+  destroy_scheduler(cfg.options.scheduler);
+  destroy_scene(scene);
+  return ok ? 0 : 1;
+}
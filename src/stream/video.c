@@ -0,0 +1,282 @@
+#include "video.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Number of frames that can wait to be written
+#define STREAM_QUEUE_SIZE 3
+
+struct VideoStream {
+  FILE *fp;
+  StreamFormat format;
+  int width, height;
+
+  // Ring of RGBA frames, filled by the caller and
+  //    written (in order) by the writer thread, where
+  //    head is the next frame to be written
+  uint8_t *frames[STREAM_QUEUE_SIZE];
+  int head, count;
+  bool closing, failed;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  // Y, U and V planes of a frame (writer only)
+  uint8_t *planes;
+};
+
+// Output
+FILE *open_standard_output();
+void *writer_main(void *data);
+bool write_frame(VideoStream *stream, uint8_t *rgba);
+
+// Conversion
+void pack_frame(Color **canvas, uint8_t *rgba, int width, int height);
+void convert_luma_row(const uint8_t *rgba, uint8_t *y, int width);
+void convert_chroma_rows(const uint8_t *row0, const uint8_t *row1, uint8_t *u,
+                         uint8_t *v, int width);
+
+VideoStream *open_video_stream(char *path, StreamFormat format, int width,
+                               int height, int fps) {
+  assert(format != STREAM_SHM);
+  FILE *fp = (strcmp(path, "-") == 0) ? open_standard_output()
+                                      : fopen(path, "wb");
+  if (fp == NULL) {
+    return NULL;
+  }
+
+  VideoStream *stream = (VideoStream *)calloc(1, sizeof(VideoStream));
+  assert(stream != NULL);
+  stream->fp = fp;
+  stream->format = format;
+  stream->width = width;
+  stream->height = height;
+
+  size_t frame_size = (size_t)4 * width * height;
+  for (int i = 0; i < STREAM_QUEUE_SIZE; i++) {
+    stream->frames[i] = (uint8_t *)malloc(frame_size);
+    assert(stream->frames[i] != NULL);
+  }
+
+  if (format == STREAM_Y4M) {
+    // 4:2:0 has one U and V sample per 2x2 block
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    stream->planes = (uint8_t *)malloc((size_t)width * height + 2 * cw * ch);
+    assert(stream->planes != NULL);
+    fprintf(fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height,
+            fps);
+  }
+
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->changed, NULL);
+  int error = pthread_create(&stream->thread, NULL, writer_main, stream);
+  assert(error == 0);
+  return stream;
+}
+
+FILE *open_standard_output() {
+  // Anything else written to the standard output
+  //    (e.g., print_vector) would corrupt the stream,
+  //    so it keeps its own copy of the descriptor and
+  //    the rest is sent to the standard error
+  fflush(stdout);
+#ifdef _WIN32
+  int fd = _dup(_fileno(stdout));
+  _dup2(_fileno(stderr), _fileno(stdout));
+  _setmode(fd, _O_BINARY);
+  return _fdopen(fd, "wb");
+#else
+  int fd = dup(STDOUT_FILENO);
+  dup2(STDERR_FILENO, STDOUT_FILENO);
+  return fdopen(fd, "wb");
+#endif
+}
+
+bool write_video_frame(VideoStream *stream, Color **canvas) {
+  // Wait for a free slot
+  pthread_mutex_lock(&stream->lock);
+  while (stream->count == STREAM_QUEUE_SIZE && !stream->failed) {
+    pthread_cond_wait(&stream->changed, &stream->lock);
+  }
+
+  if (stream->failed) {
+    pthread_mutex_unlock(&stream->lock);
+    return false;
+  }
+
+  // Slots after the head aren't touched by
+  //    the writer, so they're filled unlocked
+  int slot = (stream->head + stream->count) % STREAM_QUEUE_SIZE;
+  pthread_mutex_unlock(&stream->lock);
+  pack_frame(canvas, stream->frames[slot], stream->width, stream->height);
+
+  pthread_mutex_lock(&stream->lock);
+  stream->count++;
+  pthread_cond_broadcast(&stream->changed);
+  pthread_mutex_unlock(&stream->lock);
+  return true;
+}
+
+void *writer_main(void *data) {
+  VideoStream *stream = (VideoStream *)data;
+
+  pthread_mutex_lock(&stream->lock);
+  while (true) {
+    while (stream->count == 0 && !stream->closing) {
+      pthread_cond_wait(&stream->changed, &stream->lock);
+    }
+
+    if (stream->count == 0) {
+      // Closing and every frame was written
+      break;
+    }
+
+    uint8_t *rgba = stream->frames[stream->head];
+    pthread_mutex_unlock(&stream->lock);
+
+    // Once a write fails, the remaining
+    //    frames are discarded
+    bool written = !stream->failed && write_frame(stream, rgba);
+
+    pthread_mutex_lock(&stream->lock);
+    stream->failed = !written;
+    stream->head = (stream->head + 1) % STREAM_QUEUE_SIZE;
+    stream->count--;
+    pthread_cond_broadcast(&stream->changed);
+  }
+  pthread_mutex_unlock(&stream->lock);
+
+  return NULL;
+}
+
+bool write_frame(VideoStream *stream, uint8_t *rgba) {
+  int w = stream->width, h = stream->height;
+  if (stream->format == STREAM_RGBA) {
+    size_t size = (size_t)4 * w * h;
+    return fwrite(rgba, 1, size, stream->fp) == size && fflush(stream->fp) == 0;
+  }
+
+  // Y4M: full resolution luma, then the chroma of
+  //    each pair of rows (the last row is repeated
+  //    if the height is odd)
+  int cw = (w + 1) / 2, ch = (h + 1) / 2;
+  uint8_t *y = stream->planes;
+  uint8_t *u = y + (size_t)w * h;
+  uint8_t *v = u + (size_t)cw * ch;
+  for (int i = 0; i < h; i++) {
+    convert_luma_row(rgba + (size_t)4 * w * i, y + (size_t)w * i, w);
+  }
+  for (int i = 0; i < ch; i++) {
+    const uint8_t *row0 = rgba + (size_t)4 * w * (2 * i);
+    const uint8_t *row1 = (2 * i + 1 < h) ? row0 + (size_t)4 * w : row0;
+    convert_chroma_rows(row0, row1, u + (size_t)cw * i, v + (size_t)cw * i, w);
+  }
+
+  size_t size = (size_t)w * h + 2 * (size_t)cw * ch;
+  return fputs("FRAME\n", stream->fp) >= 0 &&
+         fwrite(stream->planes, 1, size, stream->fp) == size &&
+         fflush(stream->fp) == 0;
+}
+
+void pack_frame(Color **canvas, uint8_t *rgba, int width, int height) {
+  for (int i = 0; i < height; i++) {
+    uint8_t *row = rgba + (size_t)4 * width * i;
+    for (int j = 0; j < width; j++) {
+      Color c = canvas[i][j];
+      row[4 * j] = (uint8_t)(c.r < 0 ? 0 : (c.r > 255 ? 255 : c.r));
+      row[4 * j + 1] = (uint8_t)(c.g < 0 ? 0 : (c.g > 255 ? 255 : c.g));
+      row[4 * j + 2] = (uint8_t)(c.b < 0 ? 0 : (c.b > 255 ? 255 : c.b));
+      row[4 * j + 3] = 255;
+    }
+  }
+}
+
+// The conversions use 8-bit fixed point BT.601
+//    coefficients and no branches in the inner
+//    loops, so that optimized builds vectorize them
+void convert_luma_row(const uint8_t *rgba, uint8_t *y, int width) {
+  for (int k = 0; k < width; k++) {
+    int r = rgba[4 * k], g = rgba[4 * k + 1], b = rgba[4 * k + 2];
+    y[k] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+  }
+}
+
+void convert_chroma_rows(const uint8_t *row0, const uint8_t *row1, uint8_t *u,
+                         uint8_t *v, int width) {
+  // Each U and V sample is obtained from the sum of
+  //    a 2x2 block, hence the extra division by 4
+  int pairs = width / 2;
+  for (int k = 0; k < pairs; k++) {
+    const uint8_t *a = row0 + 8 * k, *c = row1 + 8 * k;
+    int r = a[0] + a[4] + c[0] + c[4];
+    int g = a[1] + a[5] + c[1] + c[5];
+    int b = a[2] + a[6] + c[2] + c[6];
+    u[k] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+    v[k] = (uint8_t)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+  }
+
+  // With an odd width, the last column is
+  //    a block by itself
+  if (width % 2 != 0) {
+    const uint8_t *a = row0 + 4 * (width - 1), *c = row1 + 4 * (width - 1);
+    int r = 2 * (a[0] + c[0]), g = 2 * (a[1] + c[1]), b = 2 * (a[2] + c[2]);
+    u[pairs] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+    v[pairs] = (uint8_t)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+  }
+}
+
+bool close_video_stream(VideoStream *stream) {
+  // Let the writer drain the queue
+  pthread_mutex_lock(&stream->lock);
+  stream->closing = true;
+  pthread_cond_broadcast(&stream->changed);
+  pthread_mutex_unlock(&stream->lock);
+  pthread_join(stream->thread, NULL);
+
+  bool ok = !stream->failed && fclose(stream->fp) == 0;
+  if (stream->failed) {
+    fclose(stream->fp);
+  }
+
+  // Cleanup
+  pthread_mutex_destroy(&stream->lock);
+  pthread_cond_destroy(&stream->changed);
+  for (int i = 0; i < STREAM_QUEUE_SIZE; i++) {
+    free(stream->frames[i]);
+  }
+  free(stream->planes);
+  free(stream);
+  return ok;
+}
+
+const char *stream_format_name(StreamFormat format) {
+  switch (format) {
+  case STREAM_RGBA:
+    return "rgba";
+  case STREAM_SHM:
+    return "shm";
+  default:
+    return "y4m";
+  }
+}
+
+bool parse_stream_format(const char *name, StreamFormat *format) {
+  StreamFormat formats[] = {STREAM_Y4M, STREAM_RGBA, STREAM_SHM};
+  for (int i = 0; i < 3; i++) {
+    if (strcmp(name, stream_format_name(formats[i])) == 0) {
+      *format = formats[i];
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,48 @@
+#ifndef STREAM_VIDEO
+#define STREAM_VIDEO
+#include "../core/scene.h"
+#include <stdbool.h>
+
+// Y4M (YUV 4:2:0, BT.601 studio range), raw RGBA
+//    (8 bits per channel, no header) or a ring of RGBA
+//    framebuffers in shared memory, which frames are
+//    rendered into (see shared.h) instead of a stream
+typedef enum { STREAM_Y4M, STREAM_RGBA, STREAM_SHM } StreamFormat;
+
+typedef struct VideoStream VideoStream;
+
+/*
+ * Open a stream of frames of the given size at path,
+ * which can be a regular file, a named pipe or "-" for
+ * the standard output (in which case the log messages
+ * are redirected to the standard error). Frames are
+ * converted and written by a separate thread, so that
+ * the next frame can be rendered meanwhile. Returns NULL
+ * if path can't be opened. Any format but STREAM_SHM
+ * is supported.
+ * */
+VideoStream *open_video_stream(char *path, StreamFormat format, int width,
+                               int height, int fps);
+
+/*
+ * Queue a frame. The canvas is copied, so it can be
+ * destroyed right away. Blocks while the queue is full
+ * and returns false if the stream can't be written
+ * anymore (e.g., the consumer closed the pipe).
+ * */
+bool write_video_frame(VideoStream *stream, Color **canvas);
+
+/*
+ * Write the queued frames and close the stream. Returns
+ * false if any frame couldn't be written.
+ * */
+bool close_video_stream(VideoStream *stream);
+
+/*
+ * Name of each format ("y4m", "rgba" or "shm") and its inverse,
+ * which returns false if the name isn't known.
+ * */
+const char *stream_format_name(StreamFormat format);
+bool parse_stream_format(const char *name, StreamFormat *format);
+
+#endif